@@ -0,0 +1,1003 @@
+#include <ax.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <ax.hashlist.hpp>
+#include <ax.hashlist_dynamic.hpp>
+#include <ax.hashlist_parallel.hpp>
+#include <ax.hashlist_replica.hpp>
+
+/**
+ * Benchmark suite: latency of hashlist and std containers over
+ * capacity (L1/L2/L3/DRAM-sized), load factor, hit ratio, key distribution
+ * and value size, plus hashlist-specific comparisons.
+ * Results are JSON array of records written to --out (bench.json):
+ *  {"bench": ..., "container": ..., <parameters>, "n": samples,
+ *   "mean": ..., "p50": ..., "p99": ..., "p999": ...} in rdtsc ticks.
+ * Usage: AX_HASHLIST_BENCH [--quick] [--out file.json]
+ */
+
+using namespace ax;
+
+namespace {
+    
+    // ###################### Reporting ###################### //
+    
+    struct summary {
+        size_t n;
+        double mean, p50, p99, p999;
+    };
+    
+    summary summarize(std::vector<double>& samples) {
+        std::sort(samples.begin(), samples.end());
+        summary s{samples.size(), 0, 0, 0, 0};
+        if(samples.empty())
+            return s;
+        for(auto t : samples)
+            s.mean += t;
+        s.mean /= samples.size();
+        auto at = [&samples](double q) {
+            return samples[std::min(samples.size() - 1, size_t(q*samples.size()))]; };
+        s.p50  = at(0.5);
+        s.p99  = at(0.99);
+        s.p999 = at(0.999);
+        return s;
+    }
+    
+    /// Record fields, values are JSON already
+    class fields {
+    public:
+        fields& operator()(char const* name, std::string const& value) {
+            items_.emplace_back(name, "\"" + value + "\"");
+            return *this;
+        }
+        
+        fields& operator()(char const* name, char const* value) {
+            return (*this)(name, std::string(value)); }
+        
+        fields& operator()(char const* name, double value) {
+            std::ostringstream out;
+            out << value;
+            items_.emplace_back(name, out.str());
+            return *this;
+        }
+        
+        std::vector<std::pair<std::string, std::string>> const& items() const { return items_; }
+        
+    private:
+        std::vector<std::pair<std::string, std::string>> items_;
+    };
+    
+    class report {
+    public:
+        explicit report(std::string const& path) : out_(path), first_(true) {
+            out_ << "[\n"; }
+        
+        ~report() { out_ << "\n]\n"; }
+        
+        void add(fields const& f, summary const& s) {
+            out_ << (first_ ? "" : ",\n") << "  {";
+            first_ = false;
+            for(auto const& item : f.items())
+                out_ << "\"" << item.first << "\": " << item.second << ", ";
+            out_ << "\"n\": " << s.n << ", \"mean\": " << s.mean << ", \"p50\": " << s.p50
+                 << ", \"p99\": " << s.p99 << ", \"p999\": " << s.p999 << "}";
+            out_.flush();
+        }
+        
+    private:
+        std::ofstream out_;
+        bool first_;
+    };
+    
+    /// Keeps results alive
+    volatile uint64_t sink_ = 0;
+    
+    // ###################### Workload ###################### //
+    
+    template <size_t B>
+    struct payload {
+        std::array<unsigned char, B> data;
+        
+        payload(uint64_t x = 0) { data.fill((unsigned char)x); }
+    };
+    
+    /// Bijective mixer: distinct inputs give distinct keys
+    inline uint64_t splitmix64(uint64_t x) {
+        x += 0x9e3779b97f4a7c15UL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+        return x ^ (x >> 31);
+    }
+    
+    enum class distribution { sequential, uniform, zipf };
+    
+    char const* name_of(distribution d) {
+        return d == distribution::sequential ? "sequential" :
+            d == distribution::uniform ? "uniform" : "zipf";
+    }
+    
+    /**
+     * Keys stream: present keys (sequential or random), disjoint miss keys
+     * and access pattern over present ones (in order, uniform or zipf(0.99)).
+     */
+    class workload {
+    public:
+        workload(distribution d, size_t n) : dist_(d), rng_(42), fresh_(0) {
+            keys_.resize(n);
+            for(size_t i = 0; i < n; ++i)
+                keys_[i] = key_of(i);
+            if(d == distribution::zipf) {
+                cdf_.resize(n);
+                double total = 0;
+                for(size_t r = 0; r < n; ++r)
+                    cdf_[r] = total += 1.0/std::pow(double(r + 1), 0.99);
+                for(auto& c : cdf_)
+                    c /= total;
+            }
+        }
+        
+        std::vector<uint64_t> const& keys() const { return keys_; }
+        
+        /// Index of present key to access next
+        size_t next_index(size_t i) {
+            switch(dist_) {
+            case distribution::sequential:
+                return i % keys_.size();
+            case distribution::uniform:
+                return rng_() % keys_.size();
+            default:
+                return std::min(keys_.size() - 1, size_t(std::lower_bound(cdf_.begin(), cdf_.end(),
+                    std::uniform_real_distribution<double>()(rng_)) - cdf_.begin()));
+            }
+        }
+        
+        /// Key never inserted before
+        uint64_t fresh_key() { return key_of((1UL << 40) + fresh_++); }
+        
+        void replace(size_t index, uint64_t key) { keys_[index] = key; }
+        
+        std::mt19937_64& rng() { return rng_; }
+        
+    private:
+        distribution dist_;
+        std::mt19937_64 rng_;
+        uint64_t fresh_;
+        std::vector<uint64_t> keys_;
+        std::vector<double> cdf_;
+        
+        uint64_t key_of(uint64_t i) const {
+            return dist_ == distribution::sequential ? i : splitmix64(i); }
+    };
+    
+    // ###################### Containers ###################### //
+    
+    template <class HL>
+    class hashlist_adapter {
+    public:
+        using value_type = typename HL::mapped_type;
+        
+        hashlist_adapter(size_t) : list_(new HL) {}
+        
+        static bool incremental(size_t) { return true; }
+        
+        void insert(uint64_t key, value_type const& value) {
+            list_->emplace_back(key, value); }
+        
+        value_type const* find(uint64_t key) const {
+            auto found = list_->find(key);
+            return found == list_->end() ? nullptr : &found->second;
+        }
+        
+        void erase(uint64_t key) { list_->erase(key); }
+        
+        uint64_t iterate() const {
+            uint64_t sum = 0;
+            for(auto const& p : *list_)
+                sum += p.second.data[0];
+            return sum;
+        }
+        
+        void finish() {}
+        
+    private:
+        std::unique_ptr<HL> list_;
+    };
+    
+    template <typename V>
+    class unordered_map_adapter {
+    public:
+        using value_type = V;
+        
+        unordered_map_adapter(size_t capacity) { map_.reserve(capacity); }
+        
+        static bool incremental(size_t) { return true; }
+        
+        void insert(uint64_t key, V const& value) { map_.emplace(key, value); }
+        
+        V const* find(uint64_t key) const {
+            auto found = map_.find(key);
+            return found == map_.end() ? nullptr : &found->second;
+        }
+        
+        void erase(uint64_t key) { map_.erase(key); }
+        
+        uint64_t iterate() const {
+            uint64_t sum = 0;
+            for(auto const& p : map_)
+                sum += p.second.data[0];
+            return sum;
+        }
+        
+        void finish() {}
+        
+    private:
+        std::unordered_map<uint64_t, V> map_;
+    };
+    
+    template <typename V>
+    class map_adapter {
+    public:
+        using value_type = V;
+        
+        map_adapter(size_t) {}
+        
+        static bool incremental(size_t) { return true; }
+        
+        void insert(uint64_t key, V const& value) { map_.emplace(key, value); }
+        
+        V const* find(uint64_t key) const {
+            auto found = map_.find(key);
+            return found == map_.end() ? nullptr : &found->second;
+        }
+        
+        void erase(uint64_t key) { map_.erase(key); }
+        
+        uint64_t iterate() const {
+            uint64_t sum = 0;
+            for(auto const& p : map_)
+                sum += p.second.data[0];
+            return sum;
+        }
+        
+        void finish() {}
+        
+    private:
+        std::map<uint64_t, V> map_;
+    };
+    
+    /// Incremental insertion is O(n): large vectors are built by one sort
+    template <typename V>
+    class sorted_vector_adapter {
+    public:
+        using value_type = V;
+        using element = std::pair<uint64_t, V>;
+        
+        sorted_vector_adapter(size_t capacity) : sorted_(true) { data_.reserve(capacity); }
+        
+        static bool incremental(size_t capacity) { return capacity <= (1 << 13); }
+        
+        void insert(uint64_t key, V const& value) {
+            if(!sorted_) {
+                data_.emplace_back(key, value);
+                return;
+            }
+            data_.emplace(lower(key), key, value);
+        }
+        
+        V const* find(uint64_t key) const {
+            auto found = lower(key);
+            return found == data_.end() || found->first != key ? nullptr : &found->second;
+        }
+        
+        void erase(uint64_t key) {
+            auto found = lower(key);
+            if(found != data_.end() && found->first == key)
+                data_.erase(found);
+        }
+        
+        uint64_t iterate() const {
+            uint64_t sum = 0;
+            for(auto const& p : data_)
+                sum += p.second.data[0];
+            return sum;
+        }
+        
+        /// Bulk mode: appends unsorted, finish() sorts
+        void bulk() { sorted_ = false; }
+        
+        void finish() {
+            if(!sorted_)
+                std::sort(data_.begin(), data_.end(),
+                    [](element const& a, element const& b) { return a.first < b.first; });
+            sorted_ = true;
+        }
+        
+    private:
+        std::vector<element> data_;
+        bool sorted_;
+        
+        typename std::vector<element>::const_iterator lower(uint64_t key) const {
+            return std::lower_bound(data_.begin(), data_.end(), key,
+                [](element const& e, uint64_t k) { return e.first < k; });
+        }
+    };
+    
+    template <class C>
+    void bulk(C&) {}
+    
+    template <typename V>
+    void bulk(sorted_vector_adapter<V>& c) { c.bulk(); }
+    
+    // ###################### Suite ###################### //
+    
+    struct config {
+        char const* capacity_class;
+        size_t capacity;
+        double load;
+        size_t value_size;
+        distribution dist;
+        size_t lookups;
+    };
+    
+    fields base_fields(char const* bench, char const* container, config const& cfg) {
+        fields f;
+        f("bench", bench)("container", container)("capacity_class", cfg.capacity_class)
+         ("capacity", double(cfg.capacity))("load", cfg.load)
+         ("value_size", double(cfg.value_size))("distribution", name_of(cfg.dist));
+        return f;
+    }
+    
+    /// insert (fill), find with hit ratios, erase+insert churn, iteration
+    template <class C>
+    void run(report& out, char const* container, config const& cfg) {
+        using value_type = typename C::value_type;
+        const size_t n = size_t(cfg.capacity * cfg.load);
+        workload w(cfg.dist, n);
+        C c(cfg.capacity);
+        std::vector<double> samples;
+        
+        bool incremental = C::incremental(cfg.capacity);
+        if(incremental) {
+            samples.reserve(n);
+            for(auto k : w.keys()) {
+                value_type v(k);
+                auto t = rdtsc();
+                c.insert(k, v);
+                samples.push_back(double(rdtsc() - t));
+            }
+            out.add(base_fields("insert", container, cfg), summarize(samples));
+        } else {
+            bulk(c);
+            for(auto k : w.keys())
+                c.insert(k, value_type(k));
+            c.finish();
+        }
+        
+        for(double hit_ratio : {1.0, 0.5, 0.0}) {
+            samples.clear();
+            std::bernoulli_distribution hit(hit_ratio);
+            for(size_t i = 0; i < cfg.lookups; ++i) {
+                uint64_t key = hit(w.rng()) ? w.keys()[w.next_index(i)] : w.fresh_key();
+                auto t = rdtsc();
+                auto found = c.find(key);
+                sink_ += found ? found->data[0] : 0;
+                samples.push_back(double(rdtsc() - t));
+            }
+            out.add(base_fields("find", container, cfg)("hit_ratio", hit_ratio), summarize(samples));
+        }
+        
+        if(incremental) {
+            samples.clear();
+            for(size_t i = 0; i < cfg.lookups; ++i) {
+                size_t index = w.next_index(i);
+                uint64_t key = w.fresh_key();
+                value_type v(key);
+                auto t = rdtsc();
+                c.erase(w.keys()[index]);
+                c.insert(key, v);
+                samples.push_back(double(rdtsc() - t));
+                w.replace(index, key);
+            }
+            out.add(base_fields("churn", container, cfg), summarize(samples));
+        }
+        
+        // Ticks per element of whole walks
+        samples.clear();
+        for(int pass = 0; pass < 8; ++pass) {
+            auto t = rdtsc();
+            sink_ += c.iterate();
+            samples.push_back(double(rdtsc() - t)/n);
+        }
+        out.add(base_fields("iterate", container, cfg), summarize(samples));
+    }
+    
+    template <size_t Capacity, size_t ValueSize>
+    void run_containers(report& out, config cfg) {
+        using value_type = payload<ValueSize>;
+        cfg.capacity = Capacity;
+        cfg.value_size = ValueSize;
+        std::cerr << "capacity " << Capacity << ", value " << ValueSize
+                  << ", load " << cfg.load << ", " << name_of(cfg.dist) << std::endl;
+        
+        run<hashlist_adapter<hl::hashlist<uint64_t, value_type, Capacity>>>(
+            out, "hashlist", cfg);
+        run<hashlist_adapter<hl::hashlist<uint64_t, value_type, Capacity,
+            hl::default_hash<uint64_t>, hl::group_probing>>>(out, "hashlist/group_probing", cfg);
+        run<hashlist_adapter<hl::hashlist<uint64_t, value_type, Capacity,
+            hl::default_hash<uint64_t>, hl::robin_hood>>>(out, "hashlist/robin_hood", cfg);
+        run<unordered_map_adapter<value_type>>(out, "std::unordered_map", cfg);
+        run<map_adapter<value_type>>(out, "std::map", cfg);
+        run<sorted_vector_adapter<value_type>>(out, "sorted_vector", cfg);
+    }
+    
+    template <size_t Capacity>
+    void run_capacity(report& out, char const* capacity_class, bool quick) {
+        for(double load : {0.5, 0.95})
+            for(auto dist : {distribution::sequential, distribution::uniform, distribution::zipf}) {
+                config cfg{capacity_class, Capacity, load, 0, dist, quick ? 20000UL : 200000UL};
+                run_containers<Capacity, 8>(out, cfg);
+                if(!quick)
+                    run_containers<Capacity, 64>(out, cfg);
+            }
+    }
+    
+    // ###################### Hashlist specific ###################### //
+    
+    /// Composite key of B bytes, no padding
+    template <size_t B>
+    struct blob_key {
+        uint32_t words[B/4];
+        
+        bool operator==(blob_key const& other) const {
+            return std::equal(words, words + B/4, other.words); }
+    };
+    
+    template <class Hash, typename keyT>
+    double hash_ticks(std::vector<keyT> const& keys, std::true_type) {
+        uint64_t sum = 0;
+        auto t = rdtsc();
+        for(auto const& k : keys) {
+            auto h = Hash::both(k);
+            sum += h.h1 ^ h.h2;
+        }
+        t = rdtsc() - t;
+        sink_ += sum;
+        return double(t)/keys.size();
+    }
+    
+    template <class Hash, typename keyT>
+    double hash_ticks(std::vector<keyT> const& keys, std::false_type) {
+        uint64_t sum = 0;
+        auto t = rdtsc();
+        for(auto const& k : keys)
+            sum += Hash::h1(k) ^ Hash::h2(k);
+        t = rdtsc() - t;
+        sink_ += sum;
+        return double(t)/keys.size();
+    }
+    
+    template <class Hash, typename keyT>
+    void hash_record(report& out, char const* name, std::vector<keyT> const& keys) {
+        double ticks = hash_ticks<Hash>(keys, hl::detail::has_both<Hash, keyT>());
+        out.add(fields()("bench", "hash")("hash", name)("key_size", double(sizeof(keyT))),
+            summary{keys.size(), ticks, ticks, ticks, ticks});
+    }
+    
+    template <typename keyT>
+    void hash_integral(report& out, std::vector<keyT> const& keys, std::true_type) {
+        hash_record<hl::Incremental_integer_fasthash<keyT>>(out, "Incremental_integer_fasthash", keys);
+        hash_record<hl::Fibonacci_hash<keyT>>(out, "Fibonacci_hash", keys);
+    }
+    
+    template <typename keyT>
+    void hash_integral(report&, std::vector<keyT> const&, std::false_type) {}
+    
+    template <typename keyT>
+    void hash_policies(report& out) {
+        std::mt19937 rng(42);
+        std::vector<keyT> keys(1 << 16);
+        for(auto& k : keys)
+            for(size_t byte = 0; byte < sizeof(keyT); ++byte)
+                reinterpret_cast<unsigned char*>(&k)[byte] = (unsigned char)rng();
+        
+        hash_record<hl::FNV_1<keyT>>(out, "FNV_1", keys);
+        hash_integral(out, keys, std::is_integral<keyT>());
+        hash_record<hl::CRC32C_hash<keyT>>(out, "CRC32C_hash", keys);
+        hash_record<hl::Multiply_mix_hash<keyT>>(out, "Multiply_mix_hash", keys);
+    }
+    
+    /// Scalar find() against find_batch() on DRAM-sized table, half misses
+    void find_batch_bench(report& out, bool quick) {
+        using hl_t = hl::hashlist<size_t, size_t, 1 << 21>;
+        std::unique_ptr<hl_t> pl(new hl_t);
+        hl_t const& l = *pl;
+        workload w(distribution::uniform, l.max_size()*7/10);
+        for(auto k : w.keys())
+            pl->emplace_back(k, k);
+        
+        const size_t lookups = quick ? (1 << 14) : (1 << 18);
+        const size_t batch = 32;
+        std::vector<size_t> keys(lookups);
+        for(size_t i = 0; i < lookups; ++i)
+            keys[i] = i % 2 ? w.keys()[w.next_index(i)] : w.fresh_key();
+        std::vector<hl_t::const_iterator> found(batch);
+        
+        uint64_t sums[2] = {0, 0};
+        auto scalar = rdtsc();
+        for(size_t i = 0; i < lookups; ++i) {
+            auto it = l.find(keys[i]);
+            sums[0] += it != l.end() ? it->second : 0;
+        }
+        scalar = rdtsc() - scalar;
+        
+        auto batched = rdtsc();
+        for(size_t i = 0; i < lookups; i += batch) {
+            l.find_batch(&keys[i], &keys[i] + batch, found.begin());
+            for(auto const& it : found)
+                sums[1] += it != l.end() ? it->second : 0;
+        }
+        batched = rdtsc() - batched;
+        LIGHT_TEST(sums[0] == sums[1]);
+        
+        double ticks[2] = {double(scalar)/lookups, double(batched)/lookups};
+        char const* names[2] = {"find", "find_batch"};
+        for(int i = 0; i < 2; ++i)
+            out.add(fields()("bench", names[i])("container", "hashlist")("capacity", double(l.max_size()))
+                ("load", 0.7)("hit_ratio", 0.5), summary{lookups, ticks[i], ticks[i], ticks[i], ticks[i]});
+    }
+    
+    /// find() on small integral domain: hashed against direct-indexed
+    template <class hl_t>
+    void direct_record(report& out, char const* container) {
+        std::unique_ptr<hl_t> pl(new hl_t);
+        const size_t n = hl_t::max_size()*3/4;
+        for(size_t k = 0; k < n; ++k)
+            pl->emplace_back(uint16_t(k), k);
+        
+        std::mt19937 rng(42);
+        std::vector<double> samples;
+        for(size_t i = 0; i < (1 << 16); ++i) {
+            uint16_t key = uint16_t(rng() % n);
+            auto t = rdtsc();
+            sink_ += pl->find(key)->second;
+            samples.push_back(double(rdtsc() - t));
+        }
+        out.add(fields()("bench", "find")("container", container)("key_size", 2.0)
+            ("capacity", double(hl_t::max_size()))("load", 0.75)("hit_ratio", 1.0), summarize(samples));
+    }
+    
+    /// Dedup: find() + emplace_back() against try_emplace_back()
+    void dedup_bench(report& out) {
+        using hl_t = hl::hashlist<size_t, size_t, 1 << 16>;
+        std::unique_ptr<hl_t> pl(new hl_t);
+        auto& l = *pl;
+        
+        std::mt19937 rng(42);
+        std::vector<size_t> keys(hl_t::max_size()*3/4);
+        for(auto& k : keys)
+            k = splitmix64(rng() % (keys.size()/2));
+        
+        std::vector<double> samples[2];
+        for(auto k : keys) {
+            auto t = rdtsc();
+            if(l.find(k) == l.end())
+                l.emplace_back(k, k);
+            samples[0].push_back(double(rdtsc() - t));
+        }
+        l.clear();
+        for(auto k : keys) {
+            auto t = rdtsc();
+            l.try_emplace_back(k, k);
+            samples[1].push_back(double(rdtsc() - t));
+        }
+        
+        char const* names[2] = {"find+emplace_back", "try_emplace_back"};
+        for(int i = 0; i < 2; ++i)
+            out.add(fields()("bench", "dedup")("container", "hashlist")("api", names[i])
+                ("capacity", double(hl_t::max_size())), summarize(samples[i]));
+    }
+    
+    /// Checkpointing 3/4 full table: rebuild by push_back(), block copy, snapshot
+    void checkpoint_bench(report& out, bool quick) {
+        using hl_t = hl::hashlist<uint64_t, payload<16>, 1 << 16>;
+        std::unique_ptr<hl_t> source(new hl_t), target(new hl_t);
+        for(size_t i = 0; i < hl_t::max_size()*3/4; ++i)
+            source->emplace_back(splitmix64(i), payload<16>(i));
+        
+        size_t rounds = quick ? 8 : 64;
+        std::vector<double> samples[3];
+        std::string snapshot;
+        for(size_t r = 0; r < rounds; ++r) {
+            auto t = rdtsc();
+            target->clear();
+            for(auto const& p : *source)
+                target->push_back(p);
+            samples[0].push_back(double(rdtsc() - t));
+            
+            t = rdtsc();
+            *target = *source;
+            samples[1].push_back(double(rdtsc() - t));
+            
+            std::ostringstream stream(std::move(snapshot));
+            t = rdtsc();
+            source->save(stream);
+            samples[2].push_back(double(rdtsc() - t));
+            snapshot = stream.str();
+        }
+        sink_ += target->size() + snapshot.size();
+        
+        char const* names[3] = {"rebuild", "copy", "save"};
+        for(int i = 0; i < 3; ++i)
+            out.add(fields()("bench", "checkpoint")("container", "hashlist")("api", names[i])
+                ("capacity", double(hl_t::max_size())), summarize(samples[i]));
+    }
+    
+    /// Ordered scan of churned table: iterators against for_each(), before and after compact()
+    void scan_bench(report& out, bool quick) {
+        using hl_t = hl::hashlist<uint64_t, payload<128>, 1 << 17>;
+        std::unique_ptr<hl_t> pl(new hl_t);
+        auto& l = *pl;
+        
+        std::mt19937_64 rng(42);
+        uint64_t next_id = 0;
+        while(l.size() < hl_t::max_size()*3/4)
+            l.emplace_back(next_id, payload<128>(next_id)), ++next_id;
+        for(size_t i = 0, churn = quick ? hl_t::max_size() : 4*hl_t::max_size(); i < churn; ++i) {
+            while(l.erase(rng() % next_id) == 0);
+            l.emplace_back(next_id, payload<128>(next_id));
+            ++next_id;
+        }
+        
+        enum api_t { ITERATOR, FOR_EACH, UNORDERED, PARALLEL };
+        auto scan = [&](api_t api) {
+            uint64_t sum = 0;
+            auto t = rdtsc();
+            switch(api) {
+            case ITERATOR:
+                for(auto const& p : l)
+                    sum += p.second.data[0] + p.second.data[127];
+                break;
+            case FOR_EACH:
+                l.for_each([&sum](hl_t::value_type const& p) { sum += p.second.data[0] + p.second.data[127]; });
+                break;
+            case UNORDERED:
+                l.for_each_unordered([&sum](hl_t::value_type const& p) { sum += p.second.data[0] + p.second.data[127]; });
+                break;
+            case PARALLEL:
+                sum = hl::parallel_transform_reduce(l, uint64_t(0),
+                    [](hl_t::value_type const& p) { return uint64_t(p.second.data[0] + p.second.data[127]); },
+                    [](uint64_t a, uint64_t b) { return a + b; });
+                break;
+            }
+            sink_ += sum;
+            return double(rdtsc() - t) / l.size();
+        };
+        
+        size_t rounds = quick ? 4 : 16;
+        std::vector<double> samples[6];
+        for(size_t r = 0; r < rounds; ++r) {
+            samples[0].push_back(scan(ITERATOR));
+            samples[1].push_back(scan(FOR_EACH));
+            samples[2].push_back(scan(UNORDERED));
+            samples[3].push_back(scan(PARALLEL));
+        }
+        l.compact();
+        for(size_t r = 0; r < rounds; ++r) {
+            samples[4].push_back(scan(ITERATOR));
+            samples[5].push_back(scan(FOR_EACH));
+        }
+        
+        char const* names[6] = {"iterator", "for_each", "for_each_unordered", "parallel_transform_reduce",
+                                "compact/iterator", "compact/for_each"};
+        for(int i = 0; i < 6; ++i)
+            out.add(fields()("bench", "scan")("container", "hashlist")("api", names[i])
+                ("capacity", double(hl_t::max_size()))("value_size", 128.0), summarize(samples[i]));
+    }
+    
+    /// Visiting all values of a key (order book price level): probe walk against std::unordered_multimap
+    void multimap_bench(report& out, bool quick) {
+        using hl_t = hl::hashlist<uint64_t, uint64_t, 1 << 14>;
+        const size_t keys = 256, per_key = hl_t::max_size() / 2 / keys;
+        std::unique_ptr<hl_t> pl(new hl_t);
+        std::unordered_multimap<uint64_t, uint64_t> m;
+        for(size_t i = 0; i < keys*per_key; ++i) {
+            pl->emplace_back(splitmix64(i % keys), i);
+            m.emplace(splitmix64(i % keys), i);
+        }
+        
+        std::mt19937_64 rng(42);
+        size_t rounds = quick ? (1 << 12) : (1 << 16);
+        std::vector<double> samples[2];
+        for(size_t r = 0; r < rounds; ++r) {
+            auto key = splitmix64(rng() % keys);
+            uint64_t sum = 0;
+            auto t = rdtsc();
+            pl->for_each_equal(key, [&sum](hl_t::value_type const& p) { sum += p.second; });
+            samples[0].push_back(double(rdtsc() - t));
+            
+            t = rdtsc();
+            for(auto range = m.equal_range(key); range.first != range.second; ++range.first)
+                sum += range.first->second;
+            samples[1].push_back(double(rdtsc() - t));
+            sink_ += sum;
+        }
+        
+        out.add(fields()("bench", "multimap")("container", "hashlist")("api", "for_each_equal")
+            ("values_per_key", double(per_key)), summarize(samples[0]));
+        out.add(fields()("bench", "multimap")("container", "std::unordered_multimap")("api", "equal_range")
+            ("values_per_key", double(per_key)), summarize(samples[1]));
+    }
+    
+    /// Start-of-day load of 500k symbols: emplace_back() loop against emplace_back_range()
+    void load_bench(report& out, bool quick) {
+        using hl_t = hl::hashlist<uint64_t, payload<16>, 1 << 20>;
+        std::unique_ptr<hl_t> pl(new hl_t);
+        auto& l = *pl;
+        
+        std::vector<std::pair<uint64_t, payload<16>>> snapshot;
+        for(size_t i = 0; i < 500000; ++i)
+            snapshot.emplace_back(splitmix64(i), payload<16>(i));
+        
+        size_t rounds = quick ? 2 : 8;
+        std::vector<double> samples[2];
+        for(size_t r = 0; r < rounds; ++r) {
+            l.clear();
+            auto t = rdtsc();
+            for(auto const& p : snapshot)
+                l.emplace_back(p.first, p.second);
+            samples[0].push_back(double(rdtsc() - t) / snapshot.size());
+            
+            t = rdtsc();
+            auto rest = l.assign(snapshot.begin(), snapshot.end());
+            samples[1].push_back(double(rdtsc() - t) / snapshot.size());
+            LIGHT_TEST(rest == snapshot.end());
+        }
+        
+        char const* names[2] = {"emplace_back", "assign"};
+        for(int i = 0; i < 2; ++i)
+            out.add(fields()("bench", "load")("container", "hashlist")("api", names[i])
+                ("capacity", double(hl_t::max_size()))("size", double(snapshot.size())), summarize(samples[i]));
+    }
+    
+    /// find() hits and misses over large values: interleaved cells against split hot/cold arrays
+    template <class hl_t>
+    void layout_record(report& out, char const* layout, char const* probe, bool quick) {
+        static hl_t l; // over-aligned: static storage honours alignas, new of C++11 doesn't
+        const size_t n = hl_t::max_size()*7/10;
+        for(size_t i = 0; i < n; ++i)
+            l.emplace_back(splitmix64(i), typename hl_t::mapped_type(i));
+        
+        std::mt19937_64 rng(42);
+        size_t lookups = quick ? (1 << 14) : (1 << 18);
+        std::vector<double> samples[2];
+        for(size_t i = 0; i < lookups; ++i) {
+            auto key = splitmix64(rng() % n);
+            auto t = rdtsc();
+            sink_ += l.find(key)->second.data[0];
+            samples[0].push_back(double(rdtsc() - t));
+            
+            key = splitmix64(n + rng() % n);
+            t = rdtsc();
+            sink_ += l.find(key) == l.end();
+            samples[1].push_back(double(rdtsc() - t));
+        }
+        
+        for(int i = 0; i < 2; ++i)
+            out.add(fields()("bench", "layout")("container", "hashlist")("layout", layout)("probe", probe)
+                ("capacity", double(hl_t::max_size()))("load", 0.7)("value_size", 192.0)
+                ("hit_ratio", i == 0 ? 1.0 : 0.0), summarize(samples[i]));
+        l.clear();
+    }
+    
+    void layout_bench(report& out, bool quick) {
+        using value_t = payload<192>;
+        const size_t N = 1 << 17;
+        layout_record<hl::hashlist<uint64_t, value_t, N>>(out, "interleaved", "double_hashing", quick);
+        layout_record<hl::hashlist<uint64_t, value_t, N, hl::default_hash<uint64_t>, hl::double_hashing,
+            hl::no_stats, hl::split<>>>(out, "split", "double_hashing", quick);
+        layout_record<hl::hashlist<uint64_t, value_t, N, hl::default_hash<uint64_t>, hl::group_probing>>(
+            out, "interleaved", "group_probing", quick);
+        layout_record<hl::hashlist<uint64_t, value_t, N, hl::default_hash<uint64_t>, hl::group_probing,
+            hl::no_stats, hl::split<>>>(out, "split", "group_probing", quick);
+    }
+
+    /// Update distribution: cost of publishing, replaying one record against block copy of whole table
+    void replica_bench(report& out, bool quick) {
+        using hl_t = hl::hashlist<uint64_t, payload<16>, 1 << 16>;
+        using feed_t = hl::logged<hl_t>;
+        std::unique_ptr<hl_t> pl(new hl_t);
+        std::unique_ptr<feed_t> pfeed(new feed_t);
+        auto& l = *pl;
+        auto& feed = *pfeed;
+        
+        const size_t n = hl_t::max_size()*7/10;
+        for(size_t i = 0; i < n; ++i) {
+            l.emplace_back(splitmix64(i), payload<16>(i));
+            feed.emplace_back(splitmix64(i), payload<16>(i));
+        }
+        std::unique_ptr<hl::replica<feed_t>> rep(new hl::replica<feed_t>(feed));
+        
+        std::mt19937_64 rng(42);
+        size_t updates = quick ? (1 << 14) : (1 << 18);
+        std::vector<double> samples[4];
+        for(size_t i = 0; i < updates; ++i) {
+            auto key = splitmix64(rng() % n);
+            payload<16> value(i);
+            auto t = rdtsc();
+            l.insert_or_assign(key, value);
+            samples[0].push_back(double(rdtsc() - t));
+            
+            t = rdtsc();
+            feed.insert_or_assign(key, value);
+            samples[1].push_back(double(rdtsc() - t));
+            
+            t = rdtsc();
+            sink_ += rep->poll();
+            samples[2].push_back(double(rdtsc() - t));
+        }
+        for(size_t i = 0; i < (quick ? 16 : 256); ++i) {
+            auto t = rdtsc();
+            rep->resync();
+            samples[3].push_back(double(rdtsc() - t));
+        }
+        
+        char const* containers[4] = {"hashlist", "logged", "replica", "replica"};
+        char const* apis[4] = {"insert_or_assign", "insert_or_assign", "poll", "resync"};
+        for(int i = 0; i < 4; ++i)
+            out.add(fields()("bench", "replica")("container", containers[i])("api", apis[i])
+                ("capacity", double(hl_t::max_size()))("size", double(n)), summarize(samples[i]));
+    }
+    
+    /// Prefaulted buffer: keeps page faults and munmap out of measurements
+    struct arena {
+        std::unique_ptr<char[]> buffer;
+        size_t size, used;
+        
+        explicit arena(size_t bytes) : buffer(new char[bytes]), size(bytes), used(0) {
+            std::memset(buffer.get(), 0, bytes); }
+    };
+    
+    /// Bump allocator over arena, deallocation is no-op
+    template <typename T>
+    struct arena_allocator {
+        using value_type = T;
+        
+        arena* a;
+        
+        explicit arena_allocator(arena* x) : a(x) {}
+        
+        template <typename U>
+        arena_allocator(arena_allocator<U> const& other) : a(other.a) {}
+        
+        T* allocate(size_t n) {
+            size_t offset = (a->used + 63) & ~size_t(63);
+            if(offset + n*sizeof(T) > a->size)
+                throw std::bad_alloc{};
+            a->used = offset + n*sizeof(T);
+            return reinterpret_cast<T*>(a->buffer.get() + offset);
+        }
+        
+        void deallocate(T*, size_t) {}
+    };
+    
+    /// Per insertion latency while growing from empty: incremental migration against whole rehash
+    void growth_bench(report& out, bool quick) {
+        const size_t n = quick ? (1 << 17) : (1 << 20);
+        std::vector<double> samples[3];
+        for(auto& s : samples)
+            s.reserve(n);
+
+        {
+            hl::dynamic_hashlist<uint64_t, payload<16>> l;
+            for(size_t i = 0; i < n; ++i) {
+                auto key = splitmix64(i);
+                auto t = rdtsc();
+                l.emplace_back(key, payload<16>(i));
+                samples[0].push_back(double(rdtsc() - t));
+            }
+            sink_ += l.size();
+        }
+        {
+            using alloc_t = arena_allocator<std::pair<const uint64_t, payload<16>>>;
+            arena memory(8*n*(sizeof(payload<16>) + 48));
+            hl::dynamic_hashlist<uint64_t, payload<16>, hl::default_hash<uint64_t>, alloc_t> l(0, alloc_t(&memory));
+            for(size_t i = 0; i < n; ++i) {
+                auto key = splitmix64(i);
+                auto t = rdtsc();
+                l.emplace_back(key, payload<16>(i));
+                samples[1].push_back(double(rdtsc() - t));
+            }
+            sink_ += l.size();
+        }
+        {
+            std::unordered_map<uint64_t, payload<16>> m;
+            for(size_t i = 0; i < n; ++i) {
+                auto key = splitmix64(i);
+                auto t = rdtsc();
+                m.emplace(key, payload<16>(i));
+                samples[2].push_back(double(rdtsc() - t));
+            }
+            sink_ += m.size();
+        }
+        
+        char const* names[3] = {"dynamic_hashlist", "dynamic_hashlist/arena", "std::unordered_map"};
+        for(int i = 0; i < 3; ++i) {
+            double worst = *std::max_element(samples[i].begin(), samples[i].end());
+            out.add(fields()("bench", "growth")("container", names[i])("api", "emplace")
+                ("size", double(n))("max", worst), summarize(samples[i]));
+        }
+    }
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    std::string path = "bench.json";
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--quick")
+            quick = true;
+        else if(arg == "--out" && i + 1 < argc)
+            path = argv[++i];
+        else {
+            std::cerr << "usage: " << argv[0] << " [--quick] [--out file.json]" << std::endl;
+            return 1;
+        }
+    }
+    
+    report out(path);
+    
+    {
+        // Measurement overhead, not subtracted from results
+        std::vector<double> samples;
+        for(int i = 0; i < (1 << 16); ++i) {
+            auto t = rdtsc();
+            samples.push_back(double(rdtsc() - t));
+        }
+        out.add(fields()("bench", "rdtsc_overhead"), summarize(samples));
+    }
+    
+    run_capacity<(1 << 10)>(out, "L1", quick);
+    run_capacity<(1 << 13)>(out, "L2", quick);
+    if(!quick) {
+        run_capacity<(1 << 17)>(out, "L3", quick);
+        run_capacity<(1 << 21)>(out, "DRAM", quick);
+    }
+    
+    hash_policies<uint32_t>(out);
+    hash_policies<uint64_t>(out);
+    hash_policies<blob_key<16>>(out);
+    hash_policies<blob_key<24>>(out);
+    hash_policies<blob_key<32>>(out);
+    
+    find_batch_bench(out, quick);
+    
+    direct_record<hl::hashlist<uint16_t, size_t, 1 << 16, hl::FNV_1<uint16_t>>>(out, "hashlist/FNV_1");
+    direct_record<hl::hashlist<uint16_t, size_t, 1 << 16>>(out, "hashlist");
+    direct_record<hl::direct_hashlist<uint16_t, size_t>>(out, "direct_hashlist");
+    
+    dedup_bench(out);
+    checkpoint_bench(out, quick);
+    scan_bench(out, quick);
+    growth_bench(out, quick);
+    multimap_bench(out, quick);
+    layout_bench(out, quick);
+    load_bench(out, quick);
+    replica_bench(out, quick);
+    
+    std::cerr << "results: " << path << std::endl;
+}
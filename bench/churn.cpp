@@ -0,0 +1,321 @@
+#include <ax.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <ax.hashlist.hpp>
+
+/**
+ * Steady-state churn benchmark: table is filled to target load factor,
+ * then every step inserts a fresh key and erases a random present one
+ * (so the load stays fixed) and looks up a present and an absent key.
+ * Per-operation rdtsc ticks go into HDR-style histograms, one set per
+ * epoch, so tail drift of an aging table (tombstones, scattered links)
+ * is visible per hash and probe policy. Results are JSON array:
+ *  {"bench": "churn", "hash": ..., "probe": ..., "load": ..., "epoch": ..., "op": ...,
+ *   "n": ..., "mean": ..., "p50": ..., "p99": ..., "p999": ..., "max": ...}
+ * and per configuration and op {"bench": "churn_drift", "p999_first": ...,
+ *   "p999_last": ..., "p999_worst": ..., "drift": last/first}.
+ * "iterate" samples are ticks per 64 elements of adding order walk,
+ * "rehash" ones are explicit rehash() calls once wants_rehash().
+ * Usage: AX_HASHLIST_CHURN [--quick] [--epochs n] [--ops steps per epoch] [--out file.json]
+ */
+
+using namespace ax;
+
+namespace {
+    
+    // ###################### Histogram ###################### //
+    
+    /**
+     * HDR-style log-linear histogram of tick counts: exact below 64,
+     * 32 sub-buckets per power of 2 above (relative error < 3.2%),
+     * values are clamped to 2^48. Recording is one bit scan and an increment.
+     */
+    class histogram {
+    public:
+        static constexpr unsigned SUB_BITS = 5;
+        static constexpr unsigned MAX_BITS = 48;
+        static constexpr uint64_t SUB = uint64_t(1) << SUB_BITS;
+        static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1)*SUB;
+        
+        histogram() { reset(); }
+        
+        void record(uint64_t ticks) {
+            ticks = std::min(ticks, (uint64_t(1) << MAX_BITS) - 1);
+            ++counts_[index_of(ticks)];
+            ++count_;
+            sum_ += ticks;
+            max_ = std::max(max_, ticks);
+        }
+        
+        void reset() {
+            counts_.fill(0);
+            count_ = sum_ = max_ = 0;
+        }
+        
+        uint64_t count() const { return count_; }
+        
+        uint64_t max() const { return max_; }
+        
+        double mean() const { return count_ ? double(sum_) / count_ : 0; }
+        
+        /// @returns highest value equivalent to q-quantile's bucket
+        uint64_t percentile(double q) const {
+            uint64_t rank = std::max(uint64_t(1), uint64_t(q*count_ + 0.5)), seen = 0;
+            for(size_t i = 0; i < BUCKETS; ++i)
+                if((seen += counts_[i]) >= rank)
+                    return std::min(highest_of(i), max_);
+            return max_;
+        }
+        
+    private:
+        std::array<uint64_t, BUCKETS> counts_;
+        uint64_t count_, sum_, max_;
+        
+        static size_t index_of(uint64_t v) {
+            if(v < 2*SUB)
+                return size_t(v);
+            unsigned shift = 63 - __builtin_clzll(v) - SUB_BITS;
+            return size_t(shift*SUB + (v >> shift));
+        }
+        
+        static uint64_t highest_of(size_t index) {
+            if(index < 2*SUB)
+                return index;
+            unsigned shift = unsigned(index/SUB) - 1;
+            return ((index - shift*SUB + 1) << shift) - 1;
+        }
+    };
+    
+    // ###################### Reporting ###################### //
+    
+    /// JSON array of flat records, values are JSON already
+    class report {
+    public:
+        explicit report(std::string const& path) : out_(path), first_(true) {
+            out_ << "[\n"; }
+        
+        ~report() { out_ << "\n]\n"; }
+        
+        void add(std::vector<std::pair<char const*, std::string>> const& items) {
+            out_ << (first_ ? "" : ",\n") << "  {";
+            first_ = false;
+            for(size_t i = 0; i < items.size(); ++i)
+                out_ << (i ? ", " : "") << "\"" << items[i].first << "\": " << items[i].second;
+            out_ << "}";
+            out_.flush();
+        }
+        
+    private:
+        std::ofstream out_;
+        bool first_;
+    };
+    
+    std::string json(char const* s) { return "\"" + std::string(s) + "\""; }
+    
+    std::string json(double x) {
+        std::ostringstream out;
+        out << x;
+        return out.str();
+    }
+    
+    /// Keeps results alive
+    volatile uint64_t sink_ = 0;
+    
+    // ###################### Workload ###################### //
+    
+    template <size_t B>
+    struct payload {
+        std::array<unsigned char, B> data;
+        
+        payload(uint64_t x = 0) { data.fill((unsigned char)x); }
+    };
+    
+    /// Bijective mixer: distinct inputs give distinct keys
+    inline uint64_t splitmix64(uint64_t x) {
+        x += 0x9e3779b97f4a7c15UL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+        return x ^ (x >> 31);
+    }
+    
+    struct options {
+        size_t epochs;
+        size_t steps;   // per epoch
+        std::vector<double> loads;
+    };
+    
+    enum op { find_hit, find_miss, emplace, erase, rehash, iterate, OPS };
+    
+    char const* const op_names[OPS] = {"find_hit", "find_miss", "emplace", "erase", "rehash", "iterate"};
+    
+    /// Holds table of HL at load, reports histograms of every epoch and p99.9 drift
+    template <class HL>
+    void churn(report& out, char const* hash, char const* probe, double load, options const& opt) {
+        std::unique_ptr<HL> pl(new HL);
+        auto& l = *pl;
+        
+        // Present keys are splitmix64(0, 1, ...), misses come from the upper half of inputs
+        const size_t n = size_t(HL::max_size()*load);
+        std::vector<uint64_t> keys(n);
+        uint64_t fresh = 0, absent = uint64_t(1) << 63;
+        for(auto& k : keys) {
+            k = splitmix64(fresh++);
+            l.emplace_back(k, typename HL::mapped_type(k));
+        }
+        
+        std::mt19937_64 rng(42);
+        histogram epoch[OPS];
+        std::vector<uint64_t> p999[OPS];
+        size_t failures = 0;
+        
+        auto common = [&]() {
+            return std::vector<std::pair<char const*, std::string>>{
+                {"hash", json(hash)}, {"probe", json(probe)}, {"load", json(load)},
+                {"capacity", json(double(HL::max_size()))}};
+        };
+        
+        for(size_t e = 0; e < opt.epochs; ++e) {
+            for(auto& h : epoch)
+                h.reset();
+            
+            for(size_t s = 0; s < opt.steps; ++s) {
+                size_t victim = rng() % n;
+                uint64_t key = splitmix64(fresh++);
+                typename HL::mapped_type value(key);
+                
+                // Insertion first: load never drops, failed one keeps the victim
+                auto t = rdtsc();
+                try {
+                    l.emplace_back(key, value);
+                } catch(std::bad_alloc&) {
+                    ++failures;
+                    continue;
+                }
+                epoch[emplace].record(rdtsc() - t);
+                
+                t = rdtsc();
+                l.erase(keys[victim]);
+                epoch[erase].record(rdtsc() - t);
+                keys[victim] = key;
+                
+                // Insertions never rehash: maintenance is explicit
+                if(l.wants_rehash()) {
+                    t = rdtsc();
+                    l.rehash();
+                    epoch[rehash].record(rdtsc() - t);
+                }
+                
+                key = keys[rng() % n];
+                t = rdtsc();
+                sink_ += l.find(key)->second.data[0];
+                epoch[find_hit].record(rdtsc() - t);
+                
+                key = splitmix64(absent + rng() % (uint64_t(1) << 62));
+                t = rdtsc();
+                sink_ += l.find(key) == l.end();
+                epoch[find_miss].record(rdtsc() - t);
+            }
+            
+            // Whole walk in 64 element steps
+            auto it = l.cbegin();
+            while(it != l.cend()) {
+                uint64_t sum = 0;
+                auto t = rdtsc();
+                for(int i = 0; i < 64 && it != l.cend(); ++i, ++it)
+                    sum += it->second.data[0];
+                epoch[iterate].record(rdtsc() - t);
+                sink_ += sum;
+            }
+            
+            for(int o = 0; o < OPS; ++o) {
+                auto const& h = epoch[o];
+                p999[o].push_back(h.percentile(0.999));
+                auto items = common();
+                items.insert(items.end(), {
+                    {"bench", json("churn")}, {"epoch", json(double(e))},
+                    {"steps", json(double((e + 1)*opt.steps))}, {"op", json(op_names[o])},
+                    {"tombstones", json(double(l.tombstones()))}, {"failures", json(double(failures))},
+                    {"n", json(double(h.count()))}, {"mean", json(h.mean())},
+                    {"p50", json(double(h.percentile(0.5)))}, {"p99", json(double(h.percentile(0.99)))},
+                    {"p999", json(double(p999[o].back()))}, {"max", json(double(h.max()))}});
+                out.add(items);
+            }
+        }
+        
+        for(int o = 0; o < OPS; ++o) {
+            auto const& p = p999[o];
+            if(p.empty())
+                continue;
+            double drift = double(p.back()) / std::max(uint64_t(1), p.front());
+            auto worst = *std::max_element(p.begin(), p.end());
+            auto items = common();
+            items.insert(items.end(), {
+                {"bench", json("churn_drift")}, {"op", json(op_names[o])},
+                {"epochs", json(double(opt.epochs))}, {"steps", json(double(opt.epochs*opt.steps))},
+                {"p999_first", json(double(p.front()))}, {"p999_last", json(double(p.back()))},
+                {"p999_worst", json(double(worst))}, {"drift", json(drift)}});
+            out.add(items);
+            std::cerr << hash << " / " << probe << " @ " << load << ": " << op_names[o]
+                      << " p99.9 " << p.front() << " -> " << p.back() << " (x" << drift
+                      << ", worst " << worst << ")" << std::endl;
+        }
+    }
+    
+    constexpr size_t CAPACITY = 1 << 16;
+    using value_t = payload<32>;
+    
+    template <class Hash, class Probe = hl::double_hashing>
+    void churn_loads(report& out, char const* hash, char const* probe, options const& opt) {
+        for(double load : opt.loads)
+            churn<hl::hashlist<uint64_t, value_t, CAPACITY, Hash, Probe>>(out, hash, probe, load, opt);
+    }
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    options opt{16, CAPACITY, {0.70, 0.85, 0.95}};
+    std::string path = "churn.json";
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--quick") {
+            opt.epochs = 4;
+            opt.steps = CAPACITY/8;
+        } else if(arg == "--epochs" && i + 1 < argc)
+            opt.epochs = std::stoul(argv[++i]);
+        else if(arg == "--ops" && i + 1 < argc)
+            opt.steps = std::stoul(argv[++i]);
+        else if(arg == "--out" && i + 1 < argc)
+            path = argv[++i];
+        else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--quick] [--epochs n] [--ops steps per epoch] [--out file.json]" << std::endl;
+            return 1;
+        }
+    }
+    
+    report out(path);
+    
+    // Hash policies under default probing
+    churn_loads<hl::FNV_1<uint64_t>>(out, "FNV_1", "double_hashing", opt);
+    churn_loads<hl::Incremental_integer_fasthash<uint64_t>>(out, "Incremental_integer_fasthash", "double_hashing", opt);
+    churn_loads<hl::Fibonacci_hash<uint64_t>>(out, "Fibonacci_hash", "double_hashing", opt);
+    churn_loads<hl::CRC32C_hash<uint64_t>>(out, "CRC32C_hash", "double_hashing", opt);
+    churn_loads<hl::Multiply_mix_hash<uint64_t>>(out, "Multiply_mix_hash", "double_hashing", opt);
+    
+    // Probe policies under default hash
+    churn_loads<hl::default_hash<uint64_t>, hl::group_probing>(out, "default_hash", "group_probing", opt);
+    churn_loads<hl::default_hash<uint64_t>, hl::robin_hood>(out, "default_hash", "robin_hood", opt);
+    
+    std::cerr << "results: " << path << std::endl;
+}
@@ -2,21 +2,48 @@
 
 #include <algorithm>
 #include <array>
-#include <bitset>
+#include <cerrno>
 #include <climits>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <istream>
 #include <iterator>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <tuple>
+#include <typeinfo>
 #include <utility>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
 #define LOG_HEAD "[hl]: "
 
 namespace ax { namespace hl {
     
+    /// Pair of hashes used by probe policies
+    struct hash_pair {
+        uint64_t h1;
+        uint32_t h2;
+    };
+    
     /**
      * Special default hash policy for haslist.
      * Contains FNV-1 64- and 32-bits implementations,
      * Function h2 (FNV32-1) returns odd values only.
-     * TODO: auto compile-time tuning
      */
     template <typename keyT>
     struct FNV_1 {
@@ -44,42 +71,1029 @@ namespace ax { namespace hl {
             return 1; }
     };
     
+    /**
+     * Fibonacci (multiplicative) hash policy for integral and enum keys:
+     * h1 is k*2^64/phi with reversed bytes (best mixed high bits select slot),
+     * h2 is taken from independent multiplication.
+     */
+    template <typename keyT>
+    struct Fibonacci_hash {
+        
+        static_assert(sizeof(keyT) <= sizeof(uint64_t), LOG_HEAD
+            "To use Fibonacci_hash keyT must be less than sizeof(uint64_t)");
+        
+        inline static uint64_t h1(keyT k);
+        
+        inline static uint32_t h2(keyT k) {
+            return uint32_t((static_cast<uint64_t>(k) * 0xc2b2ae3d27d4eb4fUL) >> 32) | 0x1; }
+    };
+    
+    /**
+     * Identity hash policy for direct_index: key k is stored in slot k - Min.
+     * Requires integral or enum keyT.
+     */
+    template <typename keyT, keyT Min = keyT()>
+    struct Direct_key {
+        inline static uint64_t h1(keyT k) {
+            return static_cast<uint64_t>(k) - static_cast<uint64_t>(Min); }
+        
+        inline static uint32_t h2(keyT) {
+            return 1; }
+    };
+    
+    /**
+     * Hardware CRC32C hash policy: 8 bytes of key per SSE4.2 instruction
+     * (portable table-driven fallback without SSE4.2). 32-bit CRC is
+     * spread to 64 bits by one multiplication, both h1 and odd h2
+     * are taken from it by both(). Hashes object representation:
+     * keyT must be trivially copyable without padding bytes.
+     */
+    template <typename keyT>
+    struct CRC32C_hash {
+        inline static hash_pair both(keyT const& k);
+        
+        inline static uint64_t h1(keyT const& k) { return both(k).h1; }
+        
+        inline static uint32_t h2(keyT const& k) { return both(k).h2; }
+    };
+    
+    /**
+     * Multiply-mix (wyhash-like) hash policy: 16 bytes of key are folded
+     * per 64x64->128 bit multiplication, both h1 and odd h2 are taken
+     * from one result by both(). Hashes object representation:
+     * keyT must be trivially copyable without padding bytes.
+     */
+    template <typename keyT>
+    struct Multiply_mix_hash {
+        inline static hash_pair both(keyT const& k);
+        
+        inline static uint64_t h1(keyT const& k) { return both(k).h1; }
+        
+        inline static uint32_t h2(keyT const& k) { return both(k).h2; }
+    };
+    
+    /**
+     * Default hash policy picked by key type:
+     * Fibonacci_hash for integral and enum keys, Multiply_mix_hash
+     * for other trivially copyable keys, FNV_1 otherwise.
+     */
+    template <typename keyT>
+    using default_hash = typename std::conditional<
+        std::is_integral<keyT>::value || std::is_enum<keyT>::value, Fibonacci_hash<keyT>,
+        typename std::conditional<std::is_trivially_copyable<keyT>::value,
+            Multiply_mix_hash<keyT>, FNV_1<keyT>>::type>::type;
+    
+    namespace detail {
+        
+        /// Smallest signed type holding cells offsets in [-N, N]
+        template <size_t N>
+        using offset_for = typename std::conditional<
+            (N <= INT16_MAX), int16_t, typename std::conditional<
+            (N <= INT32_MAX), int32_t, int64_t>::type>::type;
+        
+        /// Probes counter of index walks when stats are disabled
+        struct no_probe_count {
+            void operator++() {}
+            
+            void operator+=(size_t) {}
+            
+            operator size_t() const { return 0; }
+        };
+        
+        /// Detects hash policy providing both(key) -> hash_pair
+        template <class Hash, typename keyT, typename = void>
+        struct has_both : std::false_type {};
+        
+        template <class Hash, typename keyT>
+        struct has_both<Hash, keyT,
+            decltype(void(Hash::both(std::declval<keyT const&>())))> : std::true_type {};
+        
+        /// High 64 bits of 128-bit product
+        inline uint64_t mulhi(uint64_t a, uint64_t b) {
+        #if defined(__SIZEOF_INT128__)
+            __extension__ typedef unsigned __int128 uint128_t;
+            return uint64_t((uint128_t(a) * b) >> 64);
+        #else
+            uint64_t a_lo = uint32_t(a), a_hi = a >> 32;
+            uint64_t b_lo = uint32_t(b), b_hi = b >> 32;
+            uint64_t mid = a_hi*b_lo + ((a_lo*b_lo) >> 32);
+            return a_hi*b_hi + (mid >> 32) + ((a_lo*b_hi + uint32_t(mid)) >> 32);
+        #endif
+        }
+        
+        template <size_t... Is>
+        struct index_sequence {};
+        
+        template <size_t N, size_t... Is>
+        struct make_index_sequence : make_index_sequence<N - 1, N - 1, Is...> {};
+        
+        template <size_t... Is>
+        struct make_index_sequence<0, Is...> {
+            using type = index_sequence<Is...>; };
+        
+        constexpr size_t gcd(size_t a, size_t b) {
+            return b == 0 ? a : gcd(b, a % b); }
+        
+        /// First s' >= s coprime with n, n-1 always suits
+        constexpr size_t coprime_from(size_t s, size_t n) {
+            return gcd(s, n) == 1 ? s : coprime_from(s + 1, n); }
+        
+        /// Stricter of two alignments (0 - no requirement)
+        constexpr size_t stricter(size_t a, size_t b) {
+            return a > b ? a : b; }
+        
+        template <size_t N, typename Seq>
+        struct stride_table;
+        
+        /// Strides coprime with N spread over [1, N)
+        template <size_t N, size_t... Is>
+        struct stride_table<N, index_sequence<Is...>> {
+            static constexpr size_t values[sizeof...(Is)] = {
+                coprime_from(1 + Is*(N - 1)/sizeof...(Is), N)... };
+        };
+        
+        template <size_t N, size_t... Is>
+        constexpr size_t stride_table<N, index_sequence<Is...>>::values[sizeof...(Is)];
+        
+        /**
+         * Cheap arithmetic modulo N for probing: bit mask for 2^n,
+         * Lemire's fastmod with constexpr reciprocal for other N < 2^32.
+         * Probe strides are coprime with N, so sequences cover all slots.
+         */
+        template <size_t N>
+        struct modulo {
+            enum : bool { POW2 = (N & (N - 1)) == 0 };
+            enum : size_t { STRIDES = 64 };
+            
+            /// Lemire's reciprocal: ceil(2^64 / N)
+            static constexpr uint64_t M = UINT64_MAX / N + 1;
+            
+            static size_t reduce(uint64_t h) {
+                return POW2 ? size_t(h & (N - 1))
+                    : N <= UINT32_MAX ? size_t(mulhi(M * uint32_t(h ^ (h >> 32)), N))
+                    : size_t(h % N);
+            }
+            
+            /// Odd h2 suits 2^n, otherwise one of precomputed coprime strides
+            static size_t stride(uint32_t h2) {
+                using table = stride_table<N, typename make_index_sequence<STRIDES>::type>;
+                return POW2 ? size_t(h2 & (N - 1)) : table::values[h2 % STRIDES];
+            }
+            
+            /// @returns (pos + step) % N for pos, step < N
+            static size_t advance(size_t pos, size_t step) {
+                pos += step;
+                return pos >= N ? pos - N : pos;
+            }
+        };
+        
+        /**
+         * Word of table state loaded and stored by relaxed atomic
+         * operations: seqlocked readers never race with the writer.
+         * Writer is single, so compound assignments are a load and a store.
+         * Same size and layout as T, trivially copyable: whole object
+         * copies stay plain (of quiescent tables).
+         */
+        template <typename T>
+        struct relaxed {
+            T raw;
+            
+            relaxed() = default;
+            
+            relaxed(T value) : raw(value) {}
+            
+            operator T() const {
+            #if defined(__GNUC__)
+                return __atomic_load_n(&raw, __ATOMIC_RELAXED);
+            #else
+                return raw;
+            #endif
+            }
+            
+            relaxed& operator=(T value) {
+            #if defined(__GNUC__)
+                __atomic_store_n(&raw, value, __ATOMIC_RELAXED);
+            #else
+                raw = value;
+            #endif
+                return *this;
+            }
+            
+            relaxed& operator+=(T delta) { return *this = T(*this + delta); }
+            
+            relaxed& operator-=(T delta) { return *this = T(*this - delta); }
+            
+            relaxed& operator++() { return *this += 1; }
+            
+            relaxed& operator--() { return *this -= 1; }
+        };
+        
+        /// Widest word (up to 8 bytes) of objects aligned to Align, may alias objects of any type
+        template <size_t Align>
+        struct copy_word;
+        
+    #if defined(__GNUC__)
+        template <> struct copy_word<1> { typedef uint8_t  __attribute__((__may_alias__)) type; };
+        template <> struct copy_word<2> { typedef uint16_t __attribute__((__may_alias__)) type; };
+        template <> struct copy_word<4> { typedef uint32_t __attribute__((__may_alias__)) type; };
+        template <> struct copy_word<8> { typedef uint64_t __attribute__((__may_alias__)) type; };
+    #else
+        template <> struct copy_word<1> { typedef uint8_t  type; };
+        template <> struct copy_word<2> { typedef uint16_t type; };
+        template <> struct copy_word<4> { typedef uint32_t type; };
+        template <> struct copy_word<8> { typedef uint64_t type; };
+    #endif
+        
+        /**
+         * Copies *from to *to (trivially copyable) word by word,
+         * loads are relaxed atomic: *from may be stored concurrently
+         * by a writer using relaxed stores.
+         */
+        template <typename T>
+        void load_relaxed(T* to, T const* from) {
+            using word = typename copy_word<(alignof(T) < 8 ? alignof(T) : 8)>::type;
+            auto src = reinterpret_cast<word const*>(from);
+            auto dst = reinterpret_cast<word*>(to);
+            for(size_t i = 0; i < sizeof(T) / sizeof(word); ++i)
+            #if defined(__GNUC__)
+                dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+            #else
+                dst[i] = src[i];
+            #endif
+        }
+        
+        /// Same with relaxed atomic stores: *to may be loaded concurrently
+        template <typename T>
+        void store_relaxed(T* to, T const* from) {
+            using word = typename copy_word<(alignof(T) < 8 ? alignof(T) : 8)>::type;
+            auto src = reinterpret_cast<word const*>(from);
+            auto dst = reinterpret_cast<word*>(to);
+            for(size_t i = 0; i < sizeof(T) / sizeof(word); ++i)
+            #if defined(__GNUC__)
+                __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+            #else
+                dst[i] = src[i];
+            #endif
+        }
+        
+        /// Bitset of relaxed 64-bit words, scanned word by word
+        template <size_t N>
+        class relaxed_bits {
+        public:
+            relaxed_bits() { reset(); }
+            
+            bool operator[](size_t i) const {
+                return (uint64_t(words_[i / 64]) >> (i % 64)) & 1; }
+            
+            void set(size_t i) {
+                words_[i / 64] = words_[i / 64] | bit(i); }
+            
+            void reset(size_t i) {
+                words_[i / 64] = words_[i / 64] & ~bit(i); }
+            
+            void reset() {
+                for(auto& word : words_)
+                    word = 0;
+            }
+            
+            void assign(relaxed_bits const& other) {
+                for(size_t w = 0; w < WORDS; ++w)
+                    words_[w] = uint64_t(other.words_[w]);
+            }
+            
+            /// Calls f(i) for set bits of [first, last) in ascending order
+            template <typename F>
+            void for_each_set(size_t first, size_t last, F&& f) const;
+            
+        private:
+            enum : size_t { WORDS = (N + 63) / 64 };
+            
+            std::array<relaxed<uint64_t>, WORDS> words_;
+            
+            static uint64_t bit(size_t i) {
+                return uint64_t(1) << (i % 64); }
+        };
+        
+    } // detail
+    
+    /**
+     * Default probe policy: double hashing over per-slot states.
+     * Slot i is probed at (h1 + i*stride(h2)) % N, states are kept in two bitsets:
+     * occupied and erased (tombstone), never used slot stops the sequence.
+     */
+    struct double_hashing {
+        template <size_t N>
+        class index;
+    };
+    
+    /**
+     * SwissTable-like probe policy: dense array of 1-byte control tags
+     * (7 bits of h2 or empty/erased state) split into groups of 16 slots,
+     * whole group is tested by one SSE2 instruction, keys are compared
+     * only on tag match. Groups are probed by triangular numbers
+     * (linearly if number of groups isn't power of 2).
+     * Group width is fixed (not 32 under AVX2) to keep layout
+     * independent of compiler flags: table may be shared between processes.
+     */
+    struct group_probing {
+        template <size_t N>
+        class index;
+    };
+    
+    /**
+     * Robin Hood probe policy: linear probing where insertion displaces
+     * elements closer to their home slots, so probe lengths stay short
+     * and even at high load. Miss stops as soon as probed element is closer
+     * to its home than the key would be. Erasure shifts following
+     * elements back (no tombstones). Distances are kept in 1 byte:
+     * emplace_back() throws if any element would be displaced
+     * further than MAX_DISTANCE slots (bounded worst-case probe length).
+     * Displacement moves elements between slots keeping adding order,
+     * but invalidates iterators to the moved elements.
+     */
+    struct robin_hood {
+        template <size_t N>
+        class index;
+    };
+    
+    /**
+     * Probe policy without probing: slot is h1 itself, for small key
+     * domains with Direct_key hash (see direct_hashlist). Keys are unique:
+     * emplace_back() of present key or of key out of [0, N) throws.
+     * Hash must be injective on keys mapped into [0, N).
+     */
+    struct direct_index {
+        template <size_t N>
+        class index;
+    };
+    
+    /**
+     * Index interface (probe policies), @arg N - number of slots:
+     *  STABLE - erase() never relocates elements,
+     *  size(), tombstones(), occupied(slot), clear(),
+     *  find(hash_pair, eq) - @returns slot where eq(slot) or npos,
+     *  prefetch(hash_pair) - prefetches state of first probed slot, @returns the slot,
+     *  find_free(hash_pair) - @returns slot for insertion or npos if full,
+     *  find_or_free(hash_pair, eq) - one walk of find() and find_free():
+     *      @returns {found slot, true} or {slot for insertion or npos, false},
+     *  occupy(slot, hash_pair, slots) - marks slot returned by find_free()
+     *      and constructed there as used, @returns slot where element is
+     *      placed finally (may differ if policy displaces elements),
+     *  erase(slot, slots) - marks destroyed slot as unused (may relocate others),
+     *  wants_rehash(),
+     *  rehash(slots) - drops tombstones,
+     *  expected_probes(load, hit) - model's mean probe length of find(),
+     *  for_each_occupied(first, last, f) - calls f(slot) for used slots
+     *      of [first, last) in ascending order.
+     * find(), find_free() and find_or_free() increment optional probes
+     * counter per probe: per slot, per group of slots for group_probing.
+     * slots.hash(slot) must return hash_pair of stored key,
+     * slots.move(from, to) and slots.swap(a, b) must relocate stored values.
+     */
+    template <size_t N>
+    class double_hashing::index {
+    public:
+        enum : size_t { npos = N };
+        enum : bool { STABLE = true };
+        
+        index() : size_(0), tombstones_(0) {}
+        
+        size_t size()       const { return size_; }
+        size_t tombstones() const { return tombstones_; }
+        
+        bool occupied(size_t slot) const { return occupied_[slot]; }
+        
+        template <typename Eq, typename Count = detail::no_probe_count>
+        size_t find(hash_pair h, Eq&& eq, Count&& probes = Count()) const;
+        
+        size_t prefetch(hash_pair h) const;
+        
+        template <typename Count = detail::no_probe_count>
+        size_t find_free(hash_pair h, Count&& probes = Count()) const;
+        
+        template <typename Eq, typename Count = detail::no_probe_count>
+        std::pair<size_t, bool> find_or_free(hash_pair h, Eq&& eq, Count&& probes = Count()) const;
+        
+        template <typename Slots>
+        size_t occupy(size_t slot, hash_pair h, Slots&&);
+        
+        template <typename Slots>
+        void erase(size_t slot, Slots&&);
+        
+        void clear();
+        
+        template <typename F>
+        void for_each_occupied(size_t first, size_t last, F&& f) const {
+            occupied_.for_each_set(first, last, f); }
+        
+        /// Tombstones occupy most of free slots
+        bool wants_rehash() const {
+            return tombstones_ > N/16 && tombstones_ > (N - size_)/2; }
+        
+        template <typename Slots>
+        void rehash(Slots&& slots);
+        
+        /// Uniform hashing model
+        static double expected_probes(double load, bool hit);
+        
+    private:
+        detail::relaxed_bits<N> occupied_;
+        detail::relaxed_bits<N> erased_;
+        detail::relaxed<size_t> size_;
+        detail::relaxed<size_t> tombstones_;
+        
+        /// Probe sequence of slots, covers all N slots
+        class sequence {
+        public:
+            explicit sequence(hash_pair h) :
+                pos_(detail::modulo<N>::reduce(h.h1)),
+                step_(detail::modulo<N>::stride(h.h2)) {}
+            
+            size_t operator*() const { return pos_; }
+            
+            sequence& operator++() {
+                pos_ = detail::modulo<N>::advance(pos_, step_);
+                return *this;
+            }
+            
+        private:
+            size_t pos_;
+            size_t step_;
+        };
+    };
+    
+    template <size_t N>
+    class group_probing::index {
+    public:
+        enum : size_t { npos = N };
+        enum : bool { STABLE = true };
+        
+        index();
+        
+        size_t size()       const { return size_; }
+        size_t tombstones() const { return tombstones_; }
+        
+        bool occupied(size_t slot) const { return ctrl_[slot] >= 0; }
+        
+        template <typename Eq, typename Count = detail::no_probe_count>
+        size_t find(hash_pair h, Eq&& eq, Count&& probes = Count()) const;
+        
+        size_t prefetch(hash_pair h) const;
+        
+        template <typename Count = detail::no_probe_count>
+        size_t find_free(hash_pair h, Count&& probes = Count()) const;
+        
+        template <typename Eq, typename Count = detail::no_probe_count>
+        std::pair<size_t, bool> find_or_free(hash_pair h, Eq&& eq, Count&& probes = Count()) const;
+        
+        template <typename Slots>
+        size_t occupy(size_t slot, hash_pair h, Slots&&);
+        
+        template <typename Slots>
+        void erase(size_t slot, Slots&&);
+        
+        void clear();
+        
+        /// Groups are scanned by SSE2 masks
+        template <typename F>
+        void for_each_occupied(size_t first, size_t last, F&& f) const;
+        
+        bool wants_rehash() const {
+            return tombstones_ > N/16 && tombstones_ > (N - size_)/2; }
+        
+        template <typename Slots>
+        void rehash(Slots&& slots);
+        
+        /// Groups as random bins: group is passed if all its slots are used
+        static double expected_probes(double load, bool hit);
+        
+    private:
+        enum : size_t {
+            WIDTH  = 16,
+            GROUPS = (N + WIDTH - 1) / WIDTH
+        };
+        
+        /// Control byte: tag of full slot (0..127) or one of special states
+        enum ctrl_t : int8_t {
+            EMPTY    = -128,
+            ERASED   = -2,
+            SENTINEL = -1   // tail padding of the last group
+        };
+        
+        /// Bit mask of matched slots inside group
+        class group {
+        public:
+            explicit group(detail::relaxed<int8_t> const* ctrl);
+            
+            uint32_t match(int8_t tag)          const;
+            uint32_t match_empty()              const;
+            uint32_t match_empty_or_erased()    const;
+            uint32_t match_full()               const;
+            
+        private:
+        #if defined(__SSE2__)
+            __m128i ctrl_;
+        #else
+            detail::relaxed<int8_t> const* ctrl_;
+        #endif
+        };
+        
+        alignas(WIDTH) std::array<detail::relaxed<int8_t>, GROUPS*WIDTH> ctrl_;
+        detail::relaxed<size_t> size_;
+        detail::relaxed<size_t> tombstones_;
+        
+        static int8_t tag_of(hash_pair h) {
+            return int8_t(h.h2 >> 25); }
+        
+        static size_t group_of(hash_pair h) {
+            return detail::modulo<GROUPS>::reduce(h.h1); }
+        
+        /// Triangular probing g(i) = g(i-1) + i for 2^n groups, linear otherwise
+        static size_t next_group(size_t g, size_t i) {
+            return detail::modulo<GROUPS>::POW2 ? (g + i) & (GROUPS - 1)
+                : detail::modulo<GROUPS>::advance(g, 1);
+        }
+    };
+    
+    template <size_t N>
+    class direct_index::index {
+    public:
+        enum : size_t { npos = N };
+        enum : bool { STABLE = true };
+        
+        index() : size_(0) {}
+        
+        size_t size()       const { return size_; }
+        size_t tombstones() const { return 0; }
+        
+        bool occupied(size_t slot) const { return occupied_[slot]; }
+        
+        template <typename Eq, typename Count = detail::no_probe_count>
+        size_t find(hash_pair h, Eq&& eq, Count&& probes = Count()) const {
+            ++probes;
+            return h.h1 < N && occupied_[h.h1] && eq(size_t(h.h1)) ? size_t(h.h1) : npos;
+        }
+        
+        size_t prefetch(hash_pair h) const {
+            return h.h1 < N ? size_t(h.h1) : 0; }
+        
+        template <typename Count = detail::no_probe_count>
+        size_t find_free(hash_pair h, Count&& probes = Count()) const {
+            ++probes;
+            return h.h1 < N && !occupied_[h.h1] ? size_t(h.h1) : npos;
+        }
+        
+        template <typename Eq, typename Count = detail::no_probe_count>
+        std::pair<size_t, bool> find_or_free(hash_pair h, Eq&& eq, Count&& probes = Count()) const {
+            ++probes;
+            if(h.h1 >= N)
+                return {npos, false};
+            if(!occupied_[h.h1])
+                return {size_t(h.h1), false};
+            return eq(size_t(h.h1)) ? std::make_pair(size_t(h.h1), true) : std::make_pair(size_t(npos), false);
+        }
+        
+        template <typename Slots>
+        size_t occupy(size_t slot, hash_pair, Slots&&) {
+            occupied_.set(slot);
+            ++size_;
+            return slot;
+        }
+        
+        template <typename Slots>
+        void erase(size_t slot, Slots&&) {
+            occupied_.reset(slot);
+            --size_;
+        }
+        
+        void clear() {
+            occupied_.reset();
+            size_ = 0;
+        }
+        
+        template <typename F>
+        void for_each_occupied(size_t first, size_t last, F&& f) const {
+            occupied_.for_each_set(first, last, f); }
+        
+        bool wants_rehash() const { return false; }
+        
+        /// Slots are fixed by keys, nothing to rearrange
+        template <typename Slots>
+        void rehash(Slots&&) {}
+        
+        static double expected_probes(double, bool) { return 1.0; }
+        
+    private:
+        detail::relaxed_bits<N> occupied_;
+        detail::relaxed<size_t> size_;
+    };
+    
+    template <size_t N>
+    class robin_hood::index {
+    public:
+        enum : size_t { npos = N };
+        enum : bool { STABLE = false };
+        
+        /// Max distance from home slot (+1, 0 means empty)
+        enum : uint8_t { MAX_DISTANCE = 255 };
+        
+        index();
+        
+        size_t size()       const { return size_; }
+        size_t tombstones() const { return 0; }
+        
+        bool occupied(size_t slot) const { return distance_[slot] != 0; }
+        
+        template <typename Eq, typename Count = detail::no_probe_count>
+        size_t find(hash_pair h, Eq&& eq, Count&& probes = Count()) const;
+        
+        size_t prefetch(hash_pair h) const;
+        
+        /// @returns first empty slot of home's cluster
+        template <typename Count = detail::no_probe_count>
+        size_t find_free(hash_pair h, Count&& probes = Count()) const;
+        
+        template <typename Eq, typename Count = detail::no_probe_count>
+        std::pair<size_t, bool> find_or_free(hash_pair h, Eq&& eq, Count&& probes = Count()) const;
+        
+        /// Rotates element from the end of cluster to its Robin Hood position
+        template <typename Slots>
+        size_t occupy(size_t slot, hash_pair h, Slots&& slots);
+        
+        /// Backward shift deletion
+        template <typename Slots>
+        void erase(size_t slot, Slots&& slots);
+        
+        void clear();
+        
+        /// Zero words of 8 distances are skipped at once
+        template <typename F>
+        void for_each_occupied(size_t first, size_t last, F&& f) const;
+        
+        bool wants_rehash() const { return false; }
+        
+        /// Nothing to drop: layout doesn't depend on erasure history
+        template <typename Slots>
+        void rehash(Slots&&) {}
+        
+        /// Linear probing model (upper bound for misses stopped by distance)
+        static double expected_probes(double load, bool hit);
+        
+    private:
+        std::array<detail::relaxed<uint8_t>, N> distance_;
+        detail::relaxed<size_t> size_;
+        
+        static size_t home_of(hash_pair h) {
+            return detail::modulo<N>::reduce(h.h1); }
+        
+        static size_t next(size_t slot) {
+            return detail::modulo<N>::advance(slot, 1); }
+        
+        static size_t prev(size_t slot) {
+            return slot == 0 ? N - 1 : slot - 1; }
+        
+        /// @returns first slot where element of h must be placed
+        size_t position_of(hash_pair h, size_t& distance) const;
+    };
+    
+    /**
+     * Default layout policy: links and value share one cell,
+     * so key comparison of a probe reads the cell probe lands on.
+     * @arg Align - cell alignment (0 - natural), e.g. 64 keeps cells
+     *      not larger than a cache line inside one line
+     */
+    template <size_t Align = 0>
+    struct interleaved {
+        template <typename Value, typename Offset, size_t N>
+        class storage;
+    };
+    
+    /**
+     * Hot/cold layout policy: cells are split into three arrays:
+     * 32-bit hash fingerprints, links and values. Probes compare
+     * fingerprints before keys, so collisions and misses don't load
+     * values and adding order walks dense links: large values cost
+     * their cache lines on hits only. Iterators carry value pointer besides cell.
+     * @arg Align - alignment of every array (0 - natural), cache line by default
+     */
+    template <size_t Align = 64>
+    struct split {
+        template <typename Value, typename Offset, size_t N>
+        class storage;
+    };
+    
+    /**
+     * Storage interface (layout policies), @arg N - number of slots,
+     * cells[0] is sentinel, slot s lives in cells[1 + s]:
+     *  cell_t - links next_offset and prev_offset,
+     *  cells - std::array<cell_t, N + 1>,
+     *  value(cell) - storage of cell's value (constructed by hashlist),
+     *  cursor<ValPtr> - iterator's way to value, constructed from
+     *      &value(cell): get(cell) @returns value, advance(offset) follows cell,
+     *  may_hold(idx, hash_pair) - false if cells[idx] surely holds other key,
+     *  set_fingerprint(idx, hash_pair), move_fingerprint(from, to),
+     *  swap_fingerprints(a, b), copy_fingerprint(other, idx) - keep
+     *      may_hold() in sync with values,
+     *  prefetch_probe(idx) - prefetches what probe of cells[idx] reads first,
+     *  prefetch(cell) - prefetches links and all lines of cell's value.
+     * Storage is standard layout, trivially copyable values make it
+     * trivially copyable (copied and saved as a block).
+     */
+    template <size_t Align>
+    template <typename Value, typename Offset, size_t N>
+    class interleaved<Align>::storage {
+    public:
+        struct alignas(detail::stricter(Align, detail::stricter(alignof(Offset), alignof(Value)))) cell_t {
+            detail::relaxed<Offset> next_offset;
+            detail::relaxed<Offset> prev_offset;
+            typename std::aligned_storage<sizeof(Value), alignof(Value)>::type value_;
+        };
+        
+        /// Value is found by cell itself
+        template <typename ValPtr>
+        class cursor {
+        public:
+            cursor() = default;
+            
+            explicit cursor(ValPtr) {}
+            
+            template <typename V>
+            cursor(cursor<V> const&) {}
+            
+            template <typename Cell>
+            typename std::iterator_traits<ValPtr>::reference get(Cell* cell) const {
+                return *reinterpret_cast<ValPtr>(&cell->value_); }
+            
+            void advance(ptrdiff_t) {}
+        };
+        
+        std::array<cell_t, N + 1> cells;
+        
+        Value const& value(cell_t const* cell) const {
+            return *reinterpret_cast<Value const*>(&cell->value_); }
+        
+        Value& value(cell_t const* cell) {
+            return *reinterpret_cast<Value*>(&const_cast<cell_t*>(cell)->value_); }
+        
+        bool may_hold(size_t, hash_pair) const { return true; }
+        
+        void set_fingerprint(size_t, hash_pair) {}
+        
+        void move_fingerprint(size_t, size_t) {}
+        
+        void swap_fingerprints(size_t, size_t) {}
+        
+        void copy_fingerprint(storage const&, size_t) {}
+        
+        void prefetch_probe(size_t idx) const;
+        
+        void prefetch(cell_t const* cell) const;
+    };
+    
+    template <size_t Align>
+    template <typename Value, typename Offset, size_t N>
+    class split<Align>::storage {
+        using value_storage = typename std::aligned_storage<sizeof(Value), alignof(Value)>::type;
+        
+    public:
+        struct cell_t {
+            detail::relaxed<Offset> next_offset;
+            detail::relaxed<Offset> prev_offset;
+        };
+        
+        /// Values array is walked in step with cells
+        template <typename ValPtr>
+        class cursor {
+        public:
+            cursor() : value_(nullptr) {}
+            
+            explicit cursor(ValPtr value) : value_(value) {}
+            
+            template <typename V>
+            cursor(cursor<V> const& other) : value_(other.value_) {}
+            
+            template <typename Cell>
+            typename std::iterator_traits<ValPtr>::reference get(Cell*) const {
+                return *value_; }
+            
+            void advance(ptrdiff_t offset) {
+                value_ += offset; }
+            
+        private:
+            template <typename> friend class cursor;
+            
+            ValPtr value_;
+        };
+        
+        alignas(detail::stricter(Align, alignof(cell_t)))   std::array<cell_t, N + 1>                     cells;
+        alignas(detail::stricter(Align, alignof(uint32_t))) std::array<detail::relaxed<uint32_t>, N + 1>  fingerprints;
+        alignas(detail::stricter(Align, alignof(Value)))    std::array<value_storage, N + 1>              values;
+        
+        Value const& value(cell_t const* cell) const {
+            return *reinterpret_cast<Value const*>(&values[cell - cells.data()]); }
+        
+        Value& value(cell_t const* cell) {
+            return *reinterpret_cast<Value*>(&values[cell - cells.data()]); }
+        
+        bool may_hold(size_t idx, hash_pair h) const {
+            return fingerprints[idx] == fingerprint(h); }
+        
+        void set_fingerprint(size_t idx, hash_pair h) {
+            fingerprints[idx] = fingerprint(h); }
+        
+        void move_fingerprint(size_t from, size_t to) {
+            fingerprints[to] = uint32_t(fingerprints[from]); }
+        
+        void swap_fingerprints(size_t a, size_t b) {
+            uint32_t fa = fingerprints[a];
+            fingerprints[a] = uint32_t(fingerprints[b]);
+            fingerprints[b] = fa;
+        }
+        
+        void copy_fingerprint(storage const& other, size_t idx) {
+            fingerprints[idx] = uint32_t(other.fingerprints[idx]); }
+        
+        void prefetch_probe(size_t idx) const;
+        
+        void prefetch(cell_t const* cell) const;
+        
+    private:
+        /// Both halves of h1: slot is chosen by its low bits, the rest still tells keys apart
+        static uint32_t fingerprint(hash_pair h) {
+            return uint32_t(h.h1) ^ uint32_t(h.h1 >> 32); }
+    };
+    
+    /// Histogram of probe lengths, the last bucket collects longer walks
+    struct probe_histogram {
+        enum : size_t { BUCKETS = 16 };
+        
+        std::array<uint64_t, BUCKETS> counts;
+        uint64_t walks;
+        uint64_t probes;
+        
+        probe_histogram() : counts(), walks(0), probes(0) {}
+        
+        void add(size_t length) {
+            ++counts[length < BUCKETS - 1 ? length : BUCKETS - 1];
+            ++walks;
+            probes += length;
+        }
+        
+        double mean() const {
+            return walks == 0 ? 0.0 : 1.0 * probes / walks; }
+    };
+    
+    /**
+     * Stats policy interface: enabled, on_find(probes, hit),
+     * on_insert(probes, size), on_insert_failure(), on_erase(tombstones),
+     * on_rehash(). Hooks are const: const lookups are counted too.
+     * Default policy collects nothing, its hooks compile to nothing
+     * and probes aren't counted at all.
+     */
+    struct no_stats {
+        enum : bool { enabled = false };
+        
+        void on_find(size_t, bool)      const {}
+        void on_insert(size_t, size_t)  const {}
+        void on_insert_failure()        const {}
+        void on_erase(size_t)           const {}
+        void on_rehash()                const {}
+    };
+    
+    /**
+     * Stats policy collecting probe lengths of find(), emplace_back()
+     * (in units of Probe, see index interface) and occupancy peaks.
+     * Counters aren't synchronized: enable for tables accessed by one
+     * thread at a time only (not for seqlocked readers).
+     */
+    struct probe_stats {
+        enum : bool { enabled = true };
+        
+        mutable probe_histogram find_hits;
+        mutable probe_histogram find_misses;
+        mutable probe_histogram inserts;
+        mutable uint64_t insert_failures;
+        mutable uint64_t erasures;
+        mutable uint64_t rehashes;
+        mutable uint64_t peak_size;
+        mutable uint64_t peak_tombstones;
+        
+        probe_stats() :
+            insert_failures(0), erasures(0), rehashes(0), peak_size(0), peak_tombstones(0) {}
+        
+        void on_find(size_t probes, bool hit) const {
+            (hit ? find_hits : find_misses).add(probes); }
+        
+        void on_insert(size_t probes, size_t size) const {
+            inserts.add(probes);
+            peak_size = std::max<uint64_t>(peak_size, size);
+        }
+        
+        void on_insert_failure() const {
+            ++insert_failures; }
+        
+        void on_erase(size_t tombstones) const {
+            ++erasures;
+            peak_tombstones = std::max<uint64_t>(peak_tombstones, tombstones);
+        }
+        
+        void on_rehash() const {
+            ++rehashes; }
+    };
+    
+    /**
+     * Hash index snapshot made by hashlist::diagnostics().
+     * Probe costs are in units of Probe, expected ones are given
+     * by policy's model at the same load (tombstones included).
+     */
+    struct table_diagnostics {
+        enum : size_t { BUCKETS = 32 };
+        
+        size_t capacity;
+        size_t size;
+        size_t tombstones;
+        
+        /// Runs of adjacent occupied slots, clusters[i] counts runs of [2^i, 2^(i+1)) slots
+        std::array<size_t, BUCKETS> clusters;
+        size_t cluster_count;
+        size_t max_cluster;
+        double mean_cluster;
+        
+        /// Mean probes of find() over all stored elements
+        double hit_probes;
+        
+        /// Mean probes of find() missing with random hashes
+        double miss_probes;
+        
+        double expected_hit_probes;
+        double expected_miss_probes;
+    };
+    
+    /// Header of binary snapshot written by hashlist::save()
+    struct snapshot_header {
+        enum : uint64_t { MAGIC = 0x70616e736c687861UL }; // "axhlsnap"
+        enum : uint32_t { VERSION = 1 };
+        
+        uint64_t magic;
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t fingerprint;
+        uint64_t size;
+    };
+    
     /**
      * Hybrid array-list-map container.
      * @arg SIZE - max number of elements
      * @arg HashPolicy - policy contains hash functions h1() and h2()
-     *      for double-hashing. Requirements: h2() must return odd values.
+     *      for double-hashing. Requirements: h2() must return odd values
+     *      if SIZE is power of 2, any SIZE is allowed.
+     *      Optional both() returns both hashes computed at once.
+     *      Default is picked by key type (see default_hash).
+     * @arg Probe - probe policy: double_hashing (default), group_probing,
+     *      robin_hood or direct_index
+     * @arg Stats - stats policy: no_stats (default) or probe_stats,
+     *      takes no space if empty
+     * @arg Layout - storage layout policy: interleaved<> (default)
+     *      or split<> (hot/cold arrays for large values)
      */
     template <
         typename keyT,
         typename objT,
         size_t N,
-        class Hash = FNV_1<keyT>
-    > class hashlist {
+        class Hash = default_hash<keyT>,
+        class Probe = double_hashing,
+        class Stats = no_stats,
+        class Layout = interleaved<>
+    > class hashlist : private Stats {
         enum : size_t { SIZE = N };
-        using offset_t = int_least32_t;
+        using offset_t = detail::offset_for<SIZE>;
+        using index_t = typename Probe::template index<SIZE>;
+        using probes_t = typename std::conditional<Stats::enabled,
+            size_t, detail::no_probe_count>::type;
         
-        static_assert((SIZE & (SIZE - 1)) == 0, LOG_HEAD
-            "size of the container must be power of 2 (i.e. 2^n): "
-            "compile-time tuning will be implemented later");
+        /// Storage is copied, moved and saved as a block
+        enum : bool { TRIVIAL =
+            std::is_trivially_copyable<keyT>::value && std::is_trivially_copyable<objT>::value };
         
-        static_assert(SIZE <= (1UL << (sizeof(offset_t)/2*CHAR_BIT)), LOG_HEAD
-            "list size must be less than 2^16, otherwise navigation will be invalid, "
-            "please contact to your programmer to fix this");
+        static_assert(SIZE > 0, LOG_HEAD "size of the container must be positive");
         
-        struct cell_t;
+        using storage_t = typename Layout::template storage<std::pair<const keyT, objT>, offset_t, SIZE>;
+        using cell_t = typename storage_t::cell_t;
         
         template <typename DefPtr, typename ValPtr>
-        class iterator_base : public std::iterator_traits<ValPtr> {
+        class iterator_base : public std::iterator_traits<ValPtr>,
+                              private storage_t::template cursor<ValPtr> {
         private:
             using it = std::iterator_traits<ValPtr>;
+            using cursor_t = typename storage_t::template cursor<ValPtr>;
             friend class hashlist;
+            template <typename, typename> friend class iterator_base;
             
             /// Pointer to cell
             DefPtr ptr_;
             
             /// Can be constructed only by hashlist
-            iterator_base(DefPtr ptr) : ptr_(ptr) {}
+            iterator_base(DefPtr ptr, ValPtr value) : cursor_t(value), ptr_(ptr) {}
             
         public:
             using iterator_category = std::bidirectional_iterator_tag;
@@ -99,23 +1113,28 @@ namespace ax { namespace hl {
                     std::is_convertible<V, ValPtr>::value
                 >::type
             > iterator_base(iterator_base<D,V> const& other) :
-                iterator_base(other.ptr_) {}
+                cursor_t(static_cast<typename iterator_base<D,V>::cursor_t const&>(other)),
+                ptr_(other.ptr_) {}
             
             iterator_base& operator=(iterator_base const& other) = default;
             
             ~iterator_base() = default;
             
             void swap(iterator_base& other) noexcept {
-                std::swap(ptr_, other.ptr_); }
+                std::swap(ptr_, other.ptr_);
+                std::swap(static_cast<cursor_t&>(*this), static_cast<cursor_t&>(other));
+            }
             
             inline typename it::reference operator*() const {
-                return ptr_->value(); }
+                return cursor_t::get(ptr_); }
             
             inline typename it::pointer operator->() const {
                 return &(this->operator*()); }
             
             iterator_base& operator++() {
-                ptr_ += ptr_->next_offset;
+                ptrdiff_t offset = ptr_->next_offset;
+                ptr_ += offset;
+                cursor_t::advance(offset);
                 return *this;
             }
             
@@ -135,14 +1154,17 @@ namespace ax { namespace hl {
             
             // ###################### ForwardIterator ###################### //
             
-            iterator_base(); // ?
+            /// Singular iterator, can be only assigned
+            iterator_base() : cursor_t(), ptr_(nullptr) {}
             
             // TODO: see http://en.cppreference.com/w/cpp/concept/ForwardIterator
             
             // ###################### BidirectionalIterator ###################### //
             
             iterator_base& operator--() {
-                ptr_ += ptr_->prev_offset;
+                ptrdiff_t offset = ptr_->prev_offset;
+                ptr_ += offset;
+                cursor_t::advance(offset);
                 return *this;
             }
             
@@ -164,6 +1186,8 @@ namespace ax { namespace hl {
         using difference_type   = typename std::pointer_traits<value_type*>::difference_type;
         using size_type         = typename std::make_unsigned<difference_type>::type;
         using hasher            = Hash;
+        using offset_type       = offset_t;
+        using stats_type        = Stats;
         
         using iterator               = iterator_base<cell_t*,       value_type*>;
         using const_iterator         = iterator_base<cell_t const*, value_type const*>;
@@ -172,21 +1196,39 @@ namespace ax { namespace hl {
         
         /// Default c-tor, leaves storage uninitialized
         hashlist() :
-            header_(0x0) {
-            cells_[0].next_offset = 0;
-            cells_[0].prev_offset = 0;
+            header_() {
+            store_.cells[0].next_offset = 0;
+            store_.cells[0].prev_offset = 0;
         }
         
-        /// STL-like way: wont compile if value_type isn't copyable
+        /**
+         * Copy keeps cells of elements: offsets and adding order are the same,
+         * nothing is rehashed. Trivially copyable keys and values
+         * are copied with index as one block.
+         */
         hashlist(hashlist const& other) : hashlist() {
-            for(auto const& p : other)
-                push_back(p);
+            copy_from(other, std::integral_constant<bool, TRIVIAL>()); }
+        
+        /// Moves elements into the same cells, other is left empty
+        hashlist(hashlist&& other) noexcept(TRIVIAL || std::is_nothrow_move_constructible<value_type>::value) :
+            hashlist() {
+            move_from(other, std::integral_constant<bool, TRIVIAL>()); }
+        
+        /// Basic exception guarantee: container is left empty if copying throws
+        hashlist& operator=(hashlist const& other) {
+            if(this != &other)
+                copy_from(other, std::integral_constant<bool, TRIVIAL>());
+            return *this;
         }
         
-        hashlist& operator=(hashlist const& other) = delete;
+        hashlist& operator=(hashlist&& other) noexcept(TRIVIAL || std::is_nothrow_move_constructible<value_type>::value) {
+            if(this != &other)
+                move_from(other, std::integral_constant<bool, TRIVIAL>());
+            return *this;
+        }
         
         ~hashlist() {
-            clear(); }
+            destroy_all(std::is_trivially_destructible<value_type>()); }
         
         
         friend const bool operator==(hashlist const& lh, hashlist const& rh) {
@@ -196,43 +1238,95 @@ namespace ax { namespace hl {
             return !(lh == rh); }
         
         /// WARNING: uses binary swap for storage instead of value_type::swap
-        friend void swap(hashlist const& lh, hashlist const& rh) {
+        friend void swap(hashlist& lh, hashlist& rh) {
             using std::swap;
+            swap(static_cast<Stats&>(lh), static_cast<Stats&>(rh));
             swap(lh.header_, rh.header_);
-            swap(lh.cells_,  rh.cells_);
+            swap(lh.store_,  rh.store_);
         }
         
         
         // ###################### Capacity ###################### //
         
         const size_type size() const {
-            return header_.count(); }
+            return header_.size(); }
         
         static constexpr const size_type max_size() {
             return SIZE; }
         
         const bool empty() const {
-            return cells_[0].next_offset == 0; }
+            return store_.cells[0].next_offset == 0; }
         
         const float load_factor() const {
             return 1.0f * size() / max_size(); }
         
+        /// @returns number of erased slots still breaking probe sequences
+        const size_type tombstones() const {
+            return header_.tombstones(); }
+        
+        
+        // ###################### Statistics ###################### //
+        
+        /// @returns counters collected by Stats policy
+        Stats const& stats() const {
+            return *this; }
+        
+        void reset_stats() {
+            static_cast<Stats&>(*this) = Stats(); }
+        
+        /**
+         * Scans hash index: clusters of occupied slots, probe costs
+         * of all stored elements and of miss_samples random misses.
+         * Takes O(N + size*probes) time, doesn't touch stats().
+         */
+        table_diagnostics diagnostics(size_t miss_samples = 1024) const;
+        
         
         // ###################### Modifiers ###################### //
         
+        /// Resets index as a whole: O(N/word) for trivially destructible values
         void clear() {
-            for(auto i = begin(), e = end(); i != e; i = erase(i)); }
+            destroy_all(std::is_trivially_destructible<value_type>());
+            forget();
+        }
         
         /// Provides access to unitialized sentinel's object.
         mapped_type const& get_sentinel() const {
-            return cells_[0].value().second; }
+            return store_.value(store_.cells.data()).second; }
         
         mapped_type& get_sentinel() {
             return const_cast<mapped_type&>(static_cast<hashlist const*>(this)->get_sentinel()); }
         
+        /**
+         * Rebuilds hash index in-place dropping all tombstones,
+         * insertion order is kept, but elements may change their cells:
+         * invalidates iterators and offsets. Requires nothrow move of value_type.
+         */
+        void rehash();
+        
+        /**
+         * @returns true if tombstones occupy most of free slots: misses and
+         * insertions walk long sequences until explicit rehash()
+         */
+        bool wants_rehash() const {
+            return header_.wants_rehash(); }
+        
+        /**
+         * Re-places elements in adding order, each into the first free
+         * slot of its probe sequence: drops tombstones, older elements get
+         * shorter probes, list neighbours land in nearby cells as far as
+         * hash allows (e.g. incremental keys under Incremental_integer_fasthash
+         * get sequential cells back after churn). No-op under robin_hood:
+         * its layout is fixed by keys. Invalidates iterators and offsets,
+         * requires nothrow move of value_type.
+         */
+        void compact();
+        
         /**
          * Constructs element in-place.
          * Provides strong exception guarantee.
+         * Never rehashes: other elements keep their cells (see wants_rehash()).
+         * Displacing probe policy (robin_hood) may relocate other elements.
          * @returns an iterator to the inserted element 
          * TODO: to standard, 3 overloads required under hood
          */
@@ -242,35 +1336,150 @@ namespace ax { namespace hl {
         iterator push_back(const_reference value) {
             return emplace_back(value.first, value.second); }
         
+        /**
+         * Bulk emplace_back() of pairs [first, last) (ForwardIterator):
+         * keys are hashed by blocks, home slots and cells of a block
+         * are prefetched before placing, new cells are chained and
+         * linked at the back by one sentinel update per block.
+         * Doesn't throw on full table: stops at the first element
+         * without free slot. Elements placed before a throwing
+         * constructor stay. @returns iterator to the first element
+         * not inserted, last if all were
+         */
+        template <typename ForwardIt>
+        ForwardIt emplace_back_range(ForwardIt first, ForwardIt last);
+        
+        /// Replaces content by [first, last), @returns same as emplace_back_range()
+        template <typename ForwardIt>
+        ForwardIt assign(ForwardIt first, ForwardIt last) {
+            clear();
+            return emplace_back_range(first, last);
+        }
+        
+        /**
+         * Constructs element from args if key isn't present,
+         * args are left untouched otherwise. Single probe walk, doesn't throw
+         * on full table. Provides strong exception guarantee.
+         * @returns {inserted element, true}, {found element, false}
+         *      or {end(), false} if container is full
+         */
+        template <typename... Args>
+        std::pair<iterator, bool> try_emplace_back(key_type const& key, Args&&... args);
+        
+        /**
+         * Assigns obj to value of present key or inserts it at the back.
+         * @returns same as try_emplace_back()
+         */
+        template <typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type const& key, M&& obj);
+        
         const_iterator find(key_type const& key) const {
-            return const_iterator(find_cell(key)); }
+            return make_iterator(find_cell(key, hash(key))); }
         
         iterator find(key_type const& key) {
-            return iterator(const_cast<cell_t*>(find_cell(key))); }
+            return make_iterator(const_cast<cell_t*>(find_cell(key, hash(key)))); }
         
         /**
-         * @returns a reference to found or newly inserted (push_back'ed) value
-         * TODO: ambiguous meaning for array[] and map[], implement later
+         * Finds keys [first, last) (ForwardIterator), writes found
+         * iterators (end() if missing) to out. Keys are hashed and their
+         * slots are prefetched by blocks before probing, so cache misses
+         * of different keys overlap instead of going one by one.
+         * @returns out after the last written iterator
          */
-        mapped_type& operator[](key_type const& key) = delete;
+        template <typename ForwardIt, typename OutputIt>
+        OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) const;
         
-        /// @returns iterator following the removed element
+        template <typename ForwardIt, typename OutputIt>
+        OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out);
+        
+        /// @returns number of elements with key, one probe walk
+        size_type count(key_type const& key) const {
+            return visit_equal(key, [](cell_t const*) {}); }
+        
+        /**
+         * Calls f(value_type&) for every element with key during one walk
+         * of key's probe sequence: elements come in probe order, not in adding order.
+         * f mustn't insert or erase elements. @returns number of visited elements
+         */
+        template <typename F>
+        size_type for_each_equal(key_type const& key, F&& f) {
+            return visit_equal(key, [this, &f](cell_t const* cell) { f(store_.value(cell)); }); }
+        
+        template <typename F>
+        size_type for_each_equal(key_type const& key, F&& f) const {
+            return visit_equal(key, [this, &f](cell_t const* cell) { f(store_.value(cell)); }); }
+        
+        /**
+         * Writes iterators to all elements with key to out (probe order).
+         * Same-key elements aren't adjacent in adding order, so this stands
+         * for equal_range(). @returns out after the last written iterator
+         */
+        template <typename OutputIt>
+        OutputIt find_all(key_type const& key, OutputIt out) const {
+            visit_equal(key, [this, &out](cell_t const* cell) { *out++ = make_iterator(cell); });
+            return out;
+        }
+        
+        template <typename OutputIt>
+        OutputIt find_all(key_type const& key, OutputIt out) {
+            visit_equal(key, [this, &out](cell_t const* cell) { *out++ = make_iterator(const_cast<cell_t*>(cell)); });
+            return out;
+        }
+        
+        /**
+         * Map-style access: @returns value of key, default constructed one
+         * is inserted at the back if key isn't present.
+         * @throws std::bad_alloc if key isn't present and container is full
+         */
+        mapped_type& operator[](key_type const& key);
+        
+        /**
+         * Displacing probe policy (robin_hood) may relocate other elements.
+         * @returns iterator following the removed element
+         */
         iterator erase(const_iterator pos) {
-            return iterator(remove_cell(const_cast<cell_t*>(pos.ptr_))); }
+            return make_iterator(remove_cell(const_cast<cell_t*>(pos.ptr_))); }
+        
+        iterator erase(iterator pos) {
+            return erase(const_iterator(pos)); }
+        
+        /**
+         * Erases [first, last), range is unlinked by one pair of link
+         * updates (one by one under relocating Probe, e.g. robin_hood).
+         * @returns iterator following the last removed element
+         */
+        iterator erase(const_iterator first, const_iterator last);
+        
+        /// Erases min(n, size()) elements from the front
+        void pop_front(size_type n = 1);
+        
+        /**
+         * Erases element found by key (one of them if key was added several times).
+         * @returns number of erased elements
+         */
+        size_type erase(key_type const& key);
+        
+        /**
+         * Relinks element to the back (front) of adding order, value and slot
+         * are untouched: all iterators and offsets stay valid.
+         */
+        void move_to_back(const_iterator pos);
+        
+        void move_to_front(const_iterator pos);
         
         
         // ###################### Iterators ###################### //
         
-        iterator                begin()         { return iterator(&cells_[cells_[0].next_offset]); }
+        iterator                begin()         { return make_iterator(&store_.cells[store_.cells[0].next_offset]); }
         
-        const_iterator          begin()   const { return const_iterator(&cells_[cells_[0].next_offset]); }
+        const_iterator          begin()   const { return make_iterator(&store_.cells[store_.cells[0].next_offset]); }
         
         const_iterator          cbegin()  const { return begin(); }
         
         
-        iterator                end()           { return iterator(cells_.begin()); }
+        iterator                end()           { return make_iterator(store_.cells.data()); }
         
-        const_iterator          end()     const { return const_iterator(cells_.cbegin()); }
+        const_iterator          end()     const { return make_iterator(store_.cells.data()); }
         
         const_iterator          cend()    const { return end(); }
         
@@ -283,6 +1492,45 @@ namespace ax { namespace hl {
         
         const_reverse_iterator  rend()    const { return const_reverse_iterator(cbegin()); }
         
+        /**
+         * Calls f(value_type&) in adding order, cells are prefetched
+         * PREFETCH_AHEAD elements ahead: link chasing overlaps
+         * with f's work, all lines of large values are loaded in advance.
+         */
+        template <typename F>
+        void for_each(F&& f) {
+            walk_prefetched(store_, std::forward<F>(f)); }
+        
+        template <typename F>
+        void for_each(F&& f) const {
+            walk_prefetched(store_, std::forward<F>(f)); }
+        
+        /**
+         * Calls f(value_type&) in storage order: index is scanned
+         * word by word, cells are read sequentially (streaming reads
+         * instead of adding order's pointer chasing).
+         */
+        template <typename F>
+        void for_each_unordered(F&& f) {
+            for_each_in_slots(0, SIZE, f); }
+        
+        template <typename F>
+        void for_each_unordered(F&& f) const {
+            for_each_in_slots(0, SIZE, f); }
+        
+        /// Same for elements of slots [first, last), disjoint ranges may be scanned concurrently
+        template <typename F>
+        void for_each_in_slots(size_t first, size_t last, F&& f) {
+            auto& st = store_;
+            header_.for_each_occupied(first, last, [&](size_t slot) { f(st.value(&st.cells[1 + slot])); });
+        }
+        
+        template <typename F>
+        void for_each_in_slots(size_t first, size_t last, F&& f) const {
+            auto const& st = store_;
+            header_.for_each_occupied(first, last, [&](size_t slot) { f(st.value(&st.cells[1 + slot])); });
+        }
+        
         
         // ###################### Access ###################### //
         
@@ -296,42 +1544,274 @@ namespace ax { namespace hl {
         
         /// @returns offset of iterator's element inside underlying array
         const size_t offset_of_element(const_iterator const& citer) const {
-            return citer.ptr_ - &(cells_[0]); }
+            return citer.ptr_ - store_.cells.data(); }
         
         /// @returns iterator by elements offset
         iterator element_by_offset(size_t idx) {
-            return iterator(&cells_[idx]); }
+            return make_iterator(&store_.cells[idx]); }
+        
+        const_iterator element_by_offset(size_t idx) const {
+            return make_iterator(&store_.cells[idx]); }
+        
+        /**
+         * @returns offset of element linked after one at idx (0 is sentinel),
+         * computed without forming pointers: unchecked for torn reads
+         */
+        size_t linked_after(size_t idx) const {
+            return idx + size_t(ptrdiff_t(store_.cells[idx].next_offset)); }
+        
+        /// @returns true if offset addresses stored element, not free or erased cell
+        bool occupied(size_t idx) const {
+            return idx != 0 && idx <= SIZE && header_.occupied(idx - 1); }
+        
+        /**
+         * Copies other as a block by relaxed word loads: other may be
+         * changed meanwhile by its writer (see seqlocked), then the copy
+         * is torn. Requires trivially copyable keys and values.
+         */
+        void copy_relaxed(hashlist const& other);
+        
+        /**
+         * @returns fingerprint of binary layout: depends on keyT, objT, N,
+         * Hash and Probe (via mangled name) and on sizes of storage.
+         * Instances with equal fingerprints can be shared between processes.
+         */
+        static uint64_t layout_fingerprint();
+        
+        
+        // ###################### Snapshots ###################### //
+        
+        /**
+         * Writes binary snapshot: snapshot_header and storage as is
+         * (offsets and adding order are kept, stats aren't saved).
+         * Requires trivially copyable keys and values.
+         * @throws std::runtime_error if stream fails
+         */
+        void save(std::ostream& out) const;
+        
+        /**
+         * Replaces content by snapshot written by save() of the same
+         * hashlist type (layout fingerprint is validated).
+         * @throws std::runtime_error if snapshot is broken or has other
+         *      layout, container is left empty
+         */
+        void load(std::istream& in);
+        
+    #if defined(__unix__) || defined(__APPLE__)
+        /// Same as save(ostream) for file descriptor, @throws std::system_error
+        void save(int fd) const;
+        
+        /// Same as load(istream) for file descriptor, @throws std::system_error
+        void load(int fd);
+    #endif
         
     private:
-        struct cell_t {
-            offset_t next_offset;
-            offset_t prev_offset;
-            typename std::aligned_storage<
-                sizeof(value_type),
-                alignof(value_type)
-            >::type value_;
-            
-            value_type const& value() const {
-                return *reinterpret_cast<const value_type*>(&value_); }
-            
-            value_type& value() {
-                return const_cast<value_type&>(static_cast<cell_t const*>(this)->value()); }
+        /// Hash index: per-slot states of store_.cells[1..SIZE]
+        index_t header_;
+        storage_t store_;
+        
+        iterator make_iterator(cell_t* cell) {
+            return iterator(cell, &store_.value(cell)); }
+        
+        const_iterator make_iterator(cell_t const* cell) const {
+            return const_iterator(cell, &store_.value(cell)); }
+        
+        /// Slot operations required by index_t::rehash()
+        class slots_t {
+        public:
+            /// @arg tracked - cell to follow through relocations
+            explicit slots_t(hashlist& list, cell_t* tracked = nullptr) :
+                list_(list), tracked_(tracked) {}
+            
+            hash_pair hash(size_t slot) const {
+                return hashlist::hash(list_.store_.value(cell(slot)).first); }
+            
+            void move(size_t from, size_t to) {
+                if(tracked_ == cell(from))
+                    tracked_ = cell(to);
+                list_.move_cell(cell(from), cell(to));
+            }
+            
+            void swap(size_t a, size_t b) {
+                if(tracked_ == cell(a) || tracked_ == cell(b))
+                    tracked_ = tracked_ == cell(a) ? cell(b) : cell(a);
+                list_.swap_cells(cell(a), cell(b));
+            }
+            
+            cell_t* tracked() const { return tracked_; }
+            
+        private:
+            hashlist& list_;
+            cell_t* tracked_;
+            
+            cell_t* cell(size_t slot) const {
+                return &list_.store_.cells[1 + slot]; }
         };
         
-        std::bitset<SIZE> header_;
-        std::array<cell_t, SIZE + 1> cells_;
+        /// Constructs element in free slot, links it at the back
+        template <typename... Args>
+        iterator construct_back(size_t slot, hash_pair hk, key_type const& key, Args&&... args);
+        
+        /**
+         * Constructs element in free slot, links it after tail leaving
+         * sentinel's back link stale (see close_chain()). Requires stable index.
+         */
+        template <typename... Args>
+        cell_t* construct_after(cell_t* tail, size_t slot, hash_pair hk, key_type const& key, Args&&... args);
+        
+        /// Makes tail the back of list
+        void close_chain(cell_t* tail) {
+            cell_t* sentinel = store_.cells.data();
+            tail->next_offset = sentinel - tail;
+            sentinel->prev_offset = tail - sentinel;
+        }
+        
+        /**
+         * Element stores of trivial values are relaxed word stores
+         * (value is built aside), key comparisons of probes are relaxed
+         * loads: lookups of seqlocked readers don't race with the writer.
+         */
+        template <typename... Args>
+        void construct_value(cell_t* cell, key_type const& key, Args&&... args) {
+            construct_value(std::integral_constant<bool, TRIVIAL>(), cell, key, std::forward<Args>(args)...); }
+        
+        template <typename... Args>
+        void construct_value(std::false_type, cell_t* cell, key_type const& key, Args&&... args) {
+            new(&store_.value(cell)) value_type(std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+        
+        template <typename... Args>
+        void construct_value(std::true_type, cell_t* cell, key_type const& key, Args&&... args) {
+            value_type value(std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+            detail::store_relaxed(&store_.value(cell), &value);
+        }
+        
+        /// Moves value into free cell
+        void construct_moved(cell_t* to, value_type&& value, std::false_type) {
+            new(&store_.value(to)) value_type(std::move(value)); }
+        
+        void construct_moved(cell_t* to, value_type&& value, std::true_type) {
+            detail::store_relaxed(&store_.value(to), &value); }
+        
+        template <typename M>
+        static void assign_mapped(mapped_type& to, M&& obj, std::false_type) {
+            to = std::forward<M>(obj); }
+        
+        template <typename M>
+        static void assign_mapped(mapped_type& to, M&& obj, std::true_type) {
+            mapped_type value(std::forward<M>(obj));
+            detail::store_relaxed(&to, &value);
+        }
+        
+        bool holds_key(cell_t const* cell, key_type const& key) const {
+            return holds_key(cell, key, std::integral_constant<bool, TRIVIAL>()); }
+        
+        bool holds_key(cell_t const* cell, key_type const& key, std::false_type) const {
+            return store_.value(cell).first == key; }
+        
+        bool holds_key(cell_t const* cell, key_type const& key, std::true_type) const {
+            typename std::aligned_storage<sizeof(key_type), alignof(key_type)>::type stored;
+            detail::load_relaxed(reinterpret_cast<key_type*>(&stored), &store_.value(cell).first);
+            return *reinterpret_cast<key_type const*>(&stored) == key;
+        }
         
         /// General implementation, requires only key moving, TODO
         template <typename K, typename... Args>
         void emplace_back_impl(K&& key, Args&&... args);
         
         /// @returns pointer to found cell, &sentinel (==end()) if doesn't exists
-        cell_t const* find_cell(keyT const& key) const;
+        cell_t const* find_cell(keyT const& key, hash_pair hk) const;
+        
+        /// Calls f(cell) for cells with key, @returns their number
+        template <typename F>
+        size_type visit_equal(key_type const& key, F&& f) const;
+        
+        /// Keys per find_batch() block
+        enum : size_t { BATCH = 16 };
+        
+        /// Hashes up to BATCH keys from it on, prefetches their home slots and cells, @returns their number
+        template <typename ForwardIt>
+        size_t prepare_block(ForwardIt& it, ForwardIt last, std::array<hash_pair, BATCH>& hashes) const;
+        
+        /// Calls found(cell) for every key of [first, last)
+        template <typename ForwardIt, typename F>
+        void find_batch_impl(ForwardIt first, ForwardIt last, F&& found) const;
+        
+        static hash_pair hash(key_type const& key) {
+            return hash(key, detail::has_both<hasher, keyT>()); }
+        
+        static hash_pair hash(key_type const& key, std::true_type) {
+            return hasher::both(key); }
+        
+        static hash_pair hash(key_type const& key, std::false_type) {
+            return hash_pair{hasher::h1(key), hasher::h2(key)}; }
         
         /// Removes cell, @returns pointer to cell following the removed one
         cell_t* remove_cell(cell_t* cell);
+        
+        /// Excludes cell from list, its own links become stale
+        static void unlink_cell(cell_t* cell);
+        
+        /// Links cell into list before pos
+        static void link_before(cell_t* cell, cell_t* pos);
+        
+        /// Moves value from cell to unused one keeping its place in list
+        void move_cell(cell_t* from, cell_t* to);
+        
+        /// Exchanges values and list positions of two used cells
+        void swap_cells(cell_t* a, cell_t* b);
+        
+        enum : size_t { PREFETCH_AHEAD = 8 };
+        
+        /// Walks adding order of store (const or not), cells are prefetched ahead
+        template <typename Store, typename F>
+        static void walk_prefetched(Store& store, F&& f);
+        
+        /// Drops elements without destroying them
+        void forget();
+        
+        /// Calls destructors of elements, links and index are untouched
+        void destroy_all(std::true_type) {}
+        
+        void destroy_all(std::false_type);
+        
+        void copy_from(hashlist const& other, std::true_type trivial);
+        
+        void copy_from(hashlist const& other, std::false_type trivial);
+        
+        void move_from(hashlist& other, std::true_type trivial);
+        
+        void move_from(hashlist& other, std::false_type trivial);
+        
+        /**
+         * Constructs elements from value(other's cell) in the same cells,
+         * takes other's index and links. Container must be empty.
+         */
+        template <typename Value>
+        void take_cells(hashlist const& other, Value&& value);
+        
+        snapshot_header make_snapshot_header() const;
+        
+        /// Checks header read from snapshot, @throws std::runtime_error
+        static void check_snapshot_header(snapshot_header const& header);
     };
     
+    /**
+     * Direct-indexed hashlist for small integral key domains [Min, Max]
+     * (e.g. uint8_t, uint16_t or ids range): one slot per key,
+     * no hashing or probing. Keys are unique.
+     */
+    template <
+        typename keyT,
+        typename objT,
+        keyT Min = std::numeric_limits<keyT>::min(),
+        keyT Max = std::numeric_limits<keyT>::max()
+    > using direct_hashlist = hashlist<keyT, objT,
+        size_t(static_cast<uint64_t>(Max) - static_cast<uint64_t>(Min) + 1),
+        Direct_key<keyT, Min>, direct_index>;
+    
 } // hl
 } // ax
 
@@ -0,0 +1,918 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <ax.hashlist.hpp>
+
+#define LOG_HEAD "[hl]: "
+
+namespace ax { namespace hl {
+    
+    /**
+     * Runtime-capacity hashlist: same adding order list, find by key
+     * and hash policies as hashlist, storage is taken from Alloc
+     * (e.g. arena or huge pages backed) and grows without stop-the-world rehash.
+     * Cells are allocated by segments (every next one doubles capacity)
+     * and never move: iterators, pointers and references stay valid
+     * until erasure. Links are pointers, cells of different segments
+     * can't be addressed by offsets, so container isn't shareable
+     * between processes.
+     * Hash index is double hashing over 2^n entries keeping hash pairs
+     * and cell pointers. It doesn't reuse Probe policies of hashlist:
+     * their indexes are sized at compile time (bitsets, control arrays,
+     * modulo<N> constants), and incremental migration relies on tombstones
+     * keeping probe sequences of not yet moved entries intact, which
+     * robin_hood's backward shift deletion doesn't provide.
+     * Growth is incremental: the next index is cleared by CLEAR_STEP entries,
+     * then filled by MIGRATE_STEP entries of the current one per insertion
+     * or erasure, lookups probe both indexes meanwhile.
+     * Only reserve() finishes migration at once.
+     * @arg Alloc - allocator of value_type, rebound for cells and index
+     */
+    template <
+        typename keyT,
+        typename objT,
+        class Hash = default_hash<keyT>,
+        class Alloc = std::allocator<std::pair<const keyT, objT>>
+    > class dynamic_hashlist {
+        struct cell_t;
+        
+        template <typename CellPtr, typename ValPtr>
+        class iterator_base : public std::iterator_traits<ValPtr> {
+        private:
+            using it = std::iterator_traits<ValPtr>;
+            friend class dynamic_hashlist;
+            
+            CellPtr ptr_;
+            
+            iterator_base(CellPtr ptr) : ptr_(ptr) {}
+            
+        public:
+            using iterator_category = std::bidirectional_iterator_tag;
+            
+            /// Singular iterator, can be only assigned
+            iterator_base() : ptr_(nullptr) {}
+            
+            /// Constructs const_iterator from iterator
+            template <
+                typename C,
+                typename V,
+                typename = typename std::enable_if<
+                    std::is_convertible<C, CellPtr>::value &&
+                    std::is_convertible<V, ValPtr>::value
+                >::type
+            > iterator_base(iterator_base<C,V> const& other) :
+                iterator_base(other.ptr_) {}
+            
+            typename it::reference operator*() const {
+                return ptr_->value(); }
+            
+            typename it::pointer operator->() const {
+                return &ptr_->value(); }
+            
+            iterator_base& operator++() {
+                ptr_ = ptr_->next;
+                return *this;
+            }
+            
+            iterator_base operator++(int) {
+                iterator_base old(*this);
+                ptr_ = ptr_->next;
+                return old;
+            }
+            
+            iterator_base& operator--() {
+                ptr_ = ptr_->prev;
+                return *this;
+            }
+            
+            iterator_base operator--(int) {
+                iterator_base old(*this);
+                ptr_ = ptr_->prev;
+                return old;
+            }
+            
+            friend bool operator==(iterator_base const& lh, iterator_base const& rh) {
+                return lh.ptr_ == rh.ptr_; }
+            
+            friend bool operator!=(iterator_base const& lh, iterator_base const& rh) {
+                return lh.ptr_ != rh.ptr_; }
+        };
+        
+    public:
+        using key_type          = keyT;
+        using mapped_type       = objT;
+        using value_type        = std::pair<const keyT, objT>;
+        using reference         = value_type&;
+        using const_reference   = value_type const&;
+        using difference_type   = std::ptrdiff_t;
+        using size_type         = size_t;
+        using hasher            = Hash;
+        using allocator_type    = Alloc;
+        
+        using iterator               = iterator_base<cell_t*,       value_type*>;
+        using const_iterator         = iterator_base<cell_t const*, value_type const*>;
+        using reverse_iterator       = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+        
+        enum : size_t {
+            MIN_CAPACITY = 16,      // cells of the first segment at least
+            CLEAR_STEP   = 256,     // entries of the next index cleared per operation
+            MIGRATE_STEP = 16       // entries of the current index moved per operation
+        };
+        
+        /**
+         * Allocates cells for capacity elements and index keeping them
+         * at most half loaded, nothing is allocated if capacity is 0.
+         */
+        explicit dynamic_hashlist(size_type capacity = 0, allocator_type const& alloc = allocator_type());
+        
+        /// Re-inserts elements of other in adding order
+        dynamic_hashlist(dynamic_hashlist const& other);
+        
+        /// Takes storage of other (allocator is moved too), other is left empty without storage
+        dynamic_hashlist(dynamic_hashlist&& other) noexcept;
+        
+        /// Re-inserts elements of other, allocator is taken if propagate_on_container_copy_assignment
+        dynamic_hashlist& operator=(dynamic_hashlist const& other);
+        
+        /**
+         * Takes storage of other if allocator propagates or allocators are equal,
+         * moves elements one by one otherwise
+         */
+        dynamic_hashlist& operator=(dynamic_hashlist&& other)
+            noexcept(std::allocator_traits<Alloc>::propagate_on_container_move_assignment::value) {
+            if(this != &other)
+                move_assign(other, typename alloc_traits::propagate_on_container_move_assignment());
+            return *this;
+        }
+        
+        ~dynamic_hashlist();
+        
+        friend bool operator==(dynamic_hashlist const& lh, dynamic_hashlist const& rh) {
+            return lh.size() == rh.size() && std::equal(lh.begin(), lh.end(), rh.begin()); }
+        
+        friend bool operator!=(dynamic_hashlist const& lh, dynamic_hashlist const& rh) {
+            return !(lh == rh); }
+        
+        /**
+         * Exchanges storage, allocators are exchanged if propagate_on_container_swap
+         * (equal allocators are required otherwise, as for std containers)
+         */
+        void swap(dynamic_hashlist& other) noexcept;
+        
+        friend void swap(dynamic_hashlist& lh, dynamic_hashlist& rh) noexcept {
+            lh.swap(rh); }
+        
+        allocator_type get_allocator() const {
+            return allocator_type(cells_alloc_); }
+        
+        
+        // ###################### Capacity ###################### //
+        
+        size_type size() const {
+            return size_; }
+        
+        bool empty() const {
+            return size_ == 0; }
+        
+        /// @returns number of allocated cells
+        size_type capacity() const {
+            return allocated_ == 0 ? 0 : first_segment_ << (allocated_ - 1); }
+        
+        /// @returns number of entries of current hash index
+        size_type bucket_count() const {
+            return index_.slots(); }
+        
+        float load_factor() const {
+            return bucket_count() == 0 ? 0.0f : 1.0f * size() / bucket_count(); }
+        
+        /// @returns number of erased entries still breaking probe sequences
+        size_type tombstones() const {
+            return index_.erased + next_.erased; }
+        
+        /// @returns true while the next index is being cleared or filled
+        bool migrating() const {
+            return next_.entries != nullptr; }
+        
+        /**
+         * Does up to steps portions of pending growth work
+         * (e.g. when idle), @returns migrating()
+         */
+        bool migrate(size_type steps = 1);
+        
+        /**
+         * Allocates cells and index for n elements at once: the only
+         * operation doing a whole rehash, pending migration is finished.
+         */
+        void reserve(size_type n);
+        
+        
+        // ###################### Modifiers ###################### //
+        
+        /// Destroys elements and clears index in O(bucket_count()), memory is kept
+        void clear();
+        
+        /**
+         * Constructs element at the back, duplicate keys are allowed.
+         * May start or advance growth. Provides strong exception guarantee.
+         * @throws std::bad_alloc if allocator fails
+         */
+        template <typename... Args>
+        iterator emplace_back(key_type const& key, Args&&... args) {
+            return construct_back(hash(key), key, std::forward<Args>(args)...); }
+        
+        iterator push_back(const_reference value) {
+            return emplace_back(value.first, value.second); }
+        
+        /**
+         * Constructs element from args if key isn't present,
+         * args are left untouched otherwise.
+         * @returns {inserted element, true} or {found element, false}
+         */
+        template <typename... Args>
+        std::pair<iterator, bool> try_emplace_back(key_type const& key, Args&&... args);
+        
+        /// Assigns obj to value of present key or inserts it at the back
+        template <typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type const& key, M&& obj);
+        
+        mapped_type& operator[](key_type const& key) {
+            return try_emplace_back(key).first->second; }
+        
+        const_iterator find(key_type const& key) const {
+            return const_iterator(find_cell(key, hash(key))); }
+        
+        iterator find(key_type const& key) {
+            return iterator(const_cast<cell_t*>(find_cell(key, hash(key)))); }
+        
+        /// @returns number of elements with key
+        size_type count(key_type const& key) const {
+            return visit_equal(key, [](cell_t const*) {}); }
+        
+        /// Calls f(value_type&) for elements with key in probe order, see hashlist::for_each_equal()
+        template <typename F>
+        size_type for_each_equal(key_type const& key, F&& f) {
+            return visit_equal(key, [&f](cell_t const* cell) {
+                f(const_cast<cell_t*>(cell)->value()); }); }
+        
+        template <typename F>
+        size_type for_each_equal(key_type const& key, F&& f) const {
+            return visit_equal(key, [&f](cell_t const* cell) { f(cell->value()); }); }
+        
+        /// Writes iterators to all elements with key to out, see hashlist::find_all()
+        template <typename OutputIt>
+        OutputIt find_all(key_type const& key, OutputIt out) const {
+            visit_equal(key, [&out](cell_t const* cell) { *out++ = const_iterator(cell); });
+            return out;
+        }
+        
+        template <typename OutputIt>
+        OutputIt find_all(key_type const& key, OutputIt out) {
+            visit_equal(key, [&out](cell_t const* cell) { *out++ = iterator(const_cast<cell_t*>(cell)); });
+            return out;
+        }
+        
+        /// @returns iterator following the removed element
+        iterator erase(const_iterator pos);
+        
+        iterator erase(iterator pos) {
+            return erase(const_iterator(pos)); }
+        
+        /// Erases one element with key, @returns number of erased elements
+        size_type erase(key_type const& key) {
+            auto found = find(key);
+            if(found == end())
+                return 0;
+            erase(found);
+            return 1;
+        }
+        
+        /// Relinks element to the back (front) of adding order
+        void move_to_back(const_iterator pos) {
+            auto cell = const_cast<cell_t*>(pos.ptr_);
+            unlink_cell(cell);
+            link_before(cell, &sentinel_);
+        }
+        
+        void move_to_front(const_iterator pos) {
+            auto cell = const_cast<cell_t*>(pos.ptr_);
+            unlink_cell(cell);
+            link_before(cell, sentinel_.next);
+        }
+        
+        
+        // ###################### Iterators ###################### //
+        
+        iterator                begin()         { return iterator(sentinel_.next); }
+        
+        const_iterator          begin()   const { return const_iterator(sentinel_.next); }
+        
+        const_iterator          cbegin()  const { return begin(); }
+        
+        iterator                end()           { return iterator(&sentinel_); }
+        
+        const_iterator          end()     const { return const_iterator(&sentinel_); }
+        
+        const_iterator          cend()    const { return end(); }
+        
+        reverse_iterator        rbegin()        { return reverse_iterator(end()); }
+        
+        const_reverse_iterator  rbegin()  const { return const_reverse_iterator(cend()); }
+        
+        reverse_iterator        rend()          { return reverse_iterator(begin()); }
+        
+        const_reverse_iterator  rend()    const { return const_reverse_iterator(cbegin()); }
+        
+        
+        // ###################### Access ###################### //
+        
+        const_reference         front()   const { return *cbegin(); }
+        
+        reference               front()         { return *begin(); }
+        
+        const_reference         back()    const { return *(--cend()); }
+        
+        reference               back()          { return *(--end()); }
+        
+    private:
+        struct cell_t {
+            cell_t* next;
+            cell_t* prev;
+            typename std::aligned_storage<
+                sizeof(value_type),
+                alignof(value_type)
+            >::type value_;
+            
+            value_type const& value() const {
+                return *reinterpret_cast<const value_type*>(&value_); }
+            
+            value_type& value() {
+                return const_cast<value_type&>(static_cast<cell_t const*>(this)->value()); }
+        };
+        
+        /// Index entry: cell is nullptr if entry was never used, erased() if it's a tombstone
+        struct entry_t {
+            cell_t* cell;
+            hash_pair h;
+        };
+        
+        /// Hash index of 2^n entries
+        struct table_t {
+            entry_t* entries;
+            size_t mask;
+            size_t used;    // live entries and tombstones
+            size_t erased;
+            
+            size_t slots() const {
+                return entries == nullptr ? 0 : mask + 1; }
+        };
+        
+        using alloc_traits          = std::allocator_traits<Alloc>;
+        using cell_alloc_t          = typename alloc_traits::template rebind_alloc<cell_t>;
+        using entry_alloc_t         = typename alloc_traits::template rebind_alloc<entry_t>;
+        using cell_alloc_traits     = std::allocator_traits<cell_alloc_t>;
+        using entry_alloc_traits    = std::allocator_traits<entry_alloc_t>;
+        
+        /// Enough for any size_t capacity
+        enum : size_t { SEGMENTS = 64 };
+        
+        cell_alloc_t cells_alloc_;
+        entry_alloc_t entries_alloc_;
+        
+        cell_t sentinel_;
+        size_t size_;
+        
+        std::array<cell_t*, SEGMENTS> segments_;
+        size_t first_segment_;  // cells of segments_[0], 2^n
+        size_t allocated_;      // number of allocated segments
+        size_t active_;         // segment of never used cells
+        size_t fresh_;          // first never used cell of active segment
+        cell_t* free_;          // erased cells linked by next
+        
+        table_t index_;         // current index
+        table_t next_;          // index being cleared or filled while migrating()
+        size_t cleared_;        // cleared entries of next_
+        size_t migrated_;       // moved entries of index_
+        
+        static hash_pair hash(key_type const& key) {
+            return hash(key, detail::has_both<hasher, keyT>()); }
+        
+        static hash_pair hash(key_type const& key, std::true_type) {
+            return hasher::both(key); }
+        
+        static hash_pair hash(key_type const& key, std::false_type) {
+            return hash_pair{hasher::h1(key), hasher::h2(key)}; }
+        
+        static size_t ceil_pow2(size_t n) {
+            size_t p = 1;
+            while(p < n)
+                p <<= 1;
+            return p;
+        }
+        
+        /// Tombstone mark, never dereferenced
+        static cell_t* erased() {
+            static cell_t mark;
+            return &mark;
+        }
+        
+        size_t segment_size(size_t segment) const {
+            return segment == 0 ? first_segment_ : first_segment_ << (segment - 1); }
+        
+        /// @returns entry of t where eq(cell), nullptr if there is no such one
+        template <typename Eq>
+        static entry_t* probe(table_t const& t, hash_pair h, Eq&& eq);
+        
+        /// Puts cell into unused or erased entry of t
+        static void place(table_t& t, hash_pair h, cell_t* cell);
+        
+        /// Table receiving new entries
+        table_t& target() {
+            return migrating() && cleared_ == next_.slots() ? next_ : index_; }
+        
+        /// @returns pointer to found cell, &sentinel_ (==end()) if doesn't exist
+        cell_t const* find_cell(key_type const& key, hash_pair h) const;
+        
+        /// Calls f(cell) for cells with key in both indexes, @returns their number
+        template <typename F>
+        size_type visit_equal(key_type const& key, F&& f) const;
+        
+        /// Advances growth, starts it if index is half loaded
+        void prepare_insert();
+        
+        /// Allocates the next index of slots entries
+        void start_growth(size_t slots);
+        
+        /// Does one portion of pending growth
+        void growth_step();
+        
+        template <typename... Args>
+        iterator construct_back(hash_pair h, key_type const& key, Args&&... args);
+        
+        /// @returns unused cell, allocates segment if needed
+        cell_t* acquire_cell();
+        
+        void release_cell(cell_t* cell) {
+            cell->next = free_;
+            free_ = cell;
+        }
+        
+        void add_segment(size_t min_cells);
+        
+        static void unlink_cell(cell_t* cell) {
+            cell->prev->next = cell->next;
+            cell->next->prev = cell->prev;
+        }
+        
+        static void link_before(cell_t* cell, cell_t* pos) {
+            cell->prev = pos->prev;
+            cell->next = pos;
+            pos->prev->next = cell;
+            pos->prev = cell;
+        }
+        
+        /// Makes sentinel's neighbours point to it (after swap or move)
+        void relink_sentinel();
+        
+        /// Exchanges everything but allocators
+        void swap_storage(dynamic_hashlist& other) noexcept;
+        
+        void swap_allocators(dynamic_hashlist& other) noexcept {
+            using std::swap;
+            swap(cells_alloc_,      other.cells_alloc_);
+            swap(entries_alloc_,    other.entries_alloc_);
+        }
+        
+        void move_assign(dynamic_hashlist& other, std::true_type);
+        
+        void move_assign(dynamic_hashlist& other, std::false_type);
+        
+        void destroy_all(std::true_type) {}
+        
+        void destroy_all(std::false_type);
+        
+        void deallocate(table_t& t);
+        
+        /// Returns memory to allocator, leaves container empty without storage
+        void release();
+    };
+    
+    template <typename K, typename O, class H, class A>
+    dynamic_hashlist<K,O,H,A>::
+    dynamic_hashlist(size_type capacity, allocator_type const& alloc) :
+        cells_alloc_(alloc), entries_alloc_(alloc),
+        size_(0), segments_(), first_segment_(0), allocated_(0), active_(0), fresh_(0), free_(nullptr),
+        index_(), next_(), cleared_(0), migrated_(0) {
+        sentinel_.next = sentinel_.prev = &sentinel_;
+        if(capacity != 0) {
+            try {
+                reserve(capacity);
+            } catch(...) {
+                release();
+                throw;
+            }
+        }
+    }
+    
+    template <typename K, typename O, class H, class A>
+    dynamic_hashlist<K,O,H,A>::
+    dynamic_hashlist(dynamic_hashlist const& other) :
+        dynamic_hashlist(other.size(), alloc_traits::select_on_container_copy_construction(other.get_allocator())) {
+        for(auto const& value : other)
+            emplace_back(value.first, value.second);
+    }
+    
+    template <typename K, typename O, class H, class A>
+    dynamic_hashlist<K,O,H,A>::
+    dynamic_hashlist(dynamic_hashlist&& other) noexcept :
+        dynamic_hashlist(0, other.get_allocator()) {
+        swap_storage(other);
+    }
+    
+    template <typename K, typename O, class H, class A>
+    auto dynamic_hashlist<K,O,H,A>::
+    operator=(dynamic_hashlist const& other) -> dynamic_hashlist& {
+        if(this == &other)
+            return *this;
+        using pocca = typename alloc_traits::propagate_on_container_copy_assignment;
+        dynamic_hashlist copy(other.size(), pocca::value ? other.get_allocator() : get_allocator());
+        for(auto const& value : other)
+            copy.emplace_back(value.first, value.second);
+        swap_storage(copy);
+        if(pocca::value)
+            swap_allocators(copy); // old storage leaves with its allocator
+        return *this;
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    move_assign(dynamic_hashlist& other, std::true_type) {
+        dynamic_hashlist taken(std::move(other));
+        swap_storage(taken);
+        swap_allocators(taken);
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    move_assign(dynamic_hashlist& other, std::false_type) {
+        if(cells_alloc_ == other.cells_alloc_) {
+            dynamic_hashlist taken(std::move(other));
+            swap_storage(taken);
+            return;
+        }
+        clear();
+        for(auto& value : other)
+            emplace_back(value.first, std::move(value.second));
+        other.clear();
+    }
+    
+    template <typename K, typename O, class H, class A>
+    dynamic_hashlist<K,O,H,A>::
+    ~dynamic_hashlist() {
+        destroy_all(std::is_trivially_destructible<value_type>());
+        release();
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    swap(dynamic_hashlist& other) noexcept {
+        swap_storage(other);
+        if(alloc_traits::propagate_on_container_swap::value)
+            swap_allocators(other);
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    swap_storage(dynamic_hashlist& other) noexcept {
+        using std::swap;
+        swap(sentinel_.next,    other.sentinel_.next);
+        swap(sentinel_.prev,    other.sentinel_.prev);
+        swap(size_,             other.size_);
+        swap(segments_,         other.segments_);
+        swap(first_segment_,    other.first_segment_);
+        swap(allocated_,        other.allocated_);
+        swap(active_,           other.active_);
+        swap(fresh_,            other.fresh_);
+        swap(free_,             other.free_);
+        swap(index_,            other.index_);
+        swap(next_,             other.next_);
+        swap(cleared_,          other.cleared_);
+        swap(migrated_,         other.migrated_);
+        relink_sentinel();
+        other.relink_sentinel();
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    relink_sentinel() {
+        if(size_ == 0) {
+            sentinel_.next = sentinel_.prev = &sentinel_;
+        } else {
+            sentinel_.next->prev = &sentinel_;
+            sentinel_.prev->next = &sentinel_;
+        }
+    }
+    
+    template <typename K, typename O, class H, class A>
+    bool dynamic_hashlist<K,O,H,A>::
+    migrate(size_type steps) {
+        for(; steps > 0 && migrating(); --steps)
+            growth_step();
+        return migrating();
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    reserve(size_type n) {
+        if(allocated_ == 0)
+            add_segment(n);
+        while(capacity() < n)
+            add_segment(n);
+        
+        migrate(SIZE_MAX);
+        size_t slots = ceil_pow2(std::max<size_t>(2*n, 2*MIN_CAPACITY));
+        if(index_.slots() < slots) {
+            start_growth(slots);
+            migrate(SIZE_MAX);
+        }
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    clear() {
+        destroy_all(std::is_trivially_destructible<value_type>());
+        sentinel_.next = sentinel_.prev = &sentinel_;
+        size_ = 0;
+        active_ = fresh_ = 0;
+        free_ = nullptr;
+        
+        deallocate(next_);
+        std::fill_n(index_.entries, index_.slots(), entry_t());
+        index_.used = index_.erased = 0;
+    }
+    
+    template <typename K, typename O, class H, class A>
+    template <typename... Args>
+    auto dynamic_hashlist<K,O,H,A>::
+    try_emplace_back(key_type const& key, Args&&... args) -> std::pair<iterator, bool> {
+        auto h = hash(key);
+        auto found = find_cell(key, h);
+        if(found != &sentinel_)
+            return {iterator(const_cast<cell_t*>(found)), false};
+        return {construct_back(h, key, std::forward<Args>(args)...), true};
+    }
+    
+    template <typename K, typename O, class H, class A>
+    template <typename M>
+    auto dynamic_hashlist<K,O,H,A>::
+    insert_or_assign(key_type const& key, M&& obj) -> std::pair<iterator, bool> {
+        auto result = try_emplace_back(key, std::forward<M>(obj));
+        if(!result.second)
+            result.first->second = std::forward<M>(obj); // wasn't moved from
+        return result;
+    }
+    
+    template <typename K, typename O, class H, class A>
+    auto dynamic_hashlist<K,O,H,A>::
+    erase(const_iterator pos) -> iterator {
+        auto cell = const_cast<cell_t*>(pos.ptr_);
+        auto next = cell->next;
+        if(migrating())
+            growth_step();
+        
+        auto h = hash(cell->value().first);
+        auto same = [cell](cell_t const* c) { return c == cell; };
+        table_t* t = &target();
+        entry_t* entry = t == &next_ ? probe(next_, h, same) : nullptr;
+        if(entry == nullptr) {
+            t = &index_;
+            entry = probe(index_, h, same);
+        }
+        entry->cell = erased();
+        ++t->erased;
+        
+        unlink_cell(cell);
+        cell->value().~value_type();
+        release_cell(cell);
+        --size_;
+        return iterator(next);
+    }
+    
+    template <typename K, typename O, class H, class A>
+    template <typename Eq>
+    auto dynamic_hashlist<K,O,H,A>::
+    probe(table_t const& t, hash_pair h, Eq&& eq) -> entry_t* {
+        if(t.entries == nullptr)
+            return nullptr;
+        size_t pos = size_t(h.h1) & t.mask;
+        size_t stride = (size_t(h.h2) | 1) & t.mask;
+        for(size_t n = 0; n <= t.mask; ++n, pos = (pos + stride) & t.mask) {
+            entry_t& entry = t.entries[pos];
+            if(entry.cell == nullptr)
+                return nullptr;
+            if(entry.cell != erased() && entry.h.h1 == h.h1 && eq(entry.cell))
+                return &entry;
+        }
+        return nullptr;
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    place(table_t& t, hash_pair h, cell_t* cell) {
+        size_t pos = size_t(h.h1) & t.mask;
+        size_t stride = (size_t(h.h2) | 1) & t.mask;
+        for(;; pos = (pos + stride) & t.mask) {
+            entry_t& entry = t.entries[pos];
+            if(entry.cell == nullptr) {
+                ++t.used;
+                break;
+            }
+            if(entry.cell == erased()) {
+                --t.erased;
+                break;
+            }
+        }
+        t.entries[pos] = entry_t{cell, h};
+    }
+    
+    template <typename K, typename O, class H, class A>
+    auto dynamic_hashlist<K,O,H,A>::
+    find_cell(key_type const& key, hash_pair h) const -> cell_t const* {
+        if(size_ == 0)
+            return &sentinel_;
+        auto eq = [&key](cell_t const* c) { return c->value().first == key; };
+        
+        // Filled part of the next index first, the rest is still in the current one
+        entry_t* found = migrating() && cleared_ == next_.slots() ? probe(next_, h, eq) : nullptr;
+        if(found == nullptr)
+            found = probe(index_, h, eq);
+        return found == nullptr ? &sentinel_ : found->cell;
+    }
+    
+    template <typename K, typename O, class H, class A>
+    template <typename F>
+    auto dynamic_hashlist<K,O,H,A>::
+    visit_equal(key_type const& key, F&& f) const -> size_type {
+        size_type found = 0;
+        auto eq = [&](cell_t const* c) {
+            if(c->value().first == key) {
+                f(c);
+                ++found;
+            }
+            return false; // walk goes on to the end of key's probe sequence
+        };
+        hash_pair h = hash(key);
+        if(migrating() && cleared_ == next_.slots())
+            probe(next_, h, eq);
+        probe(index_, h, eq);
+        return found;
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    prepare_insert() {
+        if(migrating())
+            growth_step();
+        if(!migrating()) {
+            if(2*(index_.used + 1) > index_.slots()) {
+                // Tombstones are dropped by migration: same size is enough for mostly erased index
+                size_t slots = index_.slots() == 0 ? 2*MIN_CAPACITY :
+                    4*(size_ + 1) > index_.slots() ? 2*index_.slots() : index_.slots();
+                start_growth(slots);
+                growth_step();
+            }
+        }
+        
+        /*
+         * No catch-up is needed: growth starts at 1/2 load of S slots and
+         * ends after S/CLEAR_STEP + S/MIGRATE_STEP steps, one per insertion,
+         * so the current index stays below 1/2 + 1/256 and the next one
+         * (at least S slots, at most S/4 live entries moved) below 1/3.
+         */
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    start_growth(size_t slots) {
+        next_.entries = entry_alloc_traits::allocate(entries_alloc_, slots);
+        next_.mask = slots - 1;
+        next_.used = next_.erased = 0;
+        cleared_ = migrated_ = 0;
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    growth_step() {
+        if(cleared_ < next_.slots()) {
+            size_t n = std::min<size_t>(CLEAR_STEP, next_.slots() - cleared_);
+            std::fill_n(next_.entries + cleared_, n, entry_t());
+            cleared_ += n;
+            return;
+        }
+        
+        // Moved entries become tombstones: probe sequences of the rest stay intact
+        size_t last = std::min<size_t>(migrated_ + MIGRATE_STEP, index_.slots());
+        for(; migrated_ < last; ++migrated_) {
+            entry_t& entry = index_.entries[migrated_];
+            if(entry.cell != nullptr && entry.cell != erased()) {
+                place(next_, entry.h, entry.cell);
+                entry.cell = erased();
+            }
+        }
+        if(migrated_ == index_.slots()) {
+            deallocate(index_);
+            index_ = next_;
+            next_ = table_t();
+        }
+    }
+    
+    template <typename K, typename O, class H, class A>
+    template <typename... Args>
+    auto dynamic_hashlist<K,O,H,A>::
+    construct_back(hash_pair h, key_type const& key, Args&&... args) -> iterator {
+        prepare_insert();
+        cell_t* cell = acquire_cell();
+        try {
+            new(&cell->value()) value_type(std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        } catch(...) {
+            release_cell(cell);
+            throw;
+        }
+        link_before(cell, &sentinel_);
+        place(target(), h, cell);
+        ++size_;
+        return iterator(cell);
+    }
+    
+    template <typename K, typename O, class H, class A>
+    auto dynamic_hashlist<K,O,H,A>::
+    acquire_cell() -> cell_t* {
+        if(free_ != nullptr) {
+            cell_t* cell = free_;
+            free_ = cell->next;
+            return cell;
+        }
+        if(allocated_ != 0 && fresh_ == segment_size(active_)) {
+            ++active_;
+            fresh_ = 0;
+        }
+        if(active_ == allocated_)
+            add_segment(MIN_CAPACITY);
+        return &segments_[active_][fresh_++];
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    add_segment(size_t min_cells) {
+        if(allocated_ == SEGMENTS)
+            throw std::bad_alloc{};
+        if(allocated_ == 0)
+            first_segment_ = ceil_pow2(std::max<size_t>(min_cells, MIN_CAPACITY));
+        segments_[allocated_] = cell_alloc_traits::allocate(cells_alloc_, segment_size(allocated_));
+        ++allocated_;
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    destroy_all(std::false_type) {
+        for(cell_t* cell = sentinel_.next; cell != &sentinel_; cell = cell->next)
+            cell->value().~value_type();
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    deallocate(table_t& t) {
+        if(t.entries != nullptr)
+            entry_alloc_traits::deallocate(entries_alloc_, t.entries, t.slots());
+        t = table_t();
+    }
+    
+    template <typename K, typename O, class H, class A>
+    void dynamic_hashlist<K,O,H,A>::
+    release() {
+        for(size_t segment = 0; segment < allocated_; ++segment)
+            cell_alloc_traits::deallocate(cells_alloc_, segments_[segment], segment_size(segment));
+        deallocate(index_);
+        deallocate(next_);
+        sentinel_.next = sentinel_.prev = &sentinel_;
+        size_ = 0;
+        segments_.fill(nullptr);
+        first_segment_ = allocated_ = active_ = fresh_ = 0;
+        free_ = nullptr;
+        cleared_ = migrated_ = 0;
+    }
+    
+} // hl
+} // ax
+
+#undef LOG_HEAD
@@ -25,64 +25,1426 @@ namespace ax { namespace hl {
         return hash;
     }
     
-    template <typename K, typename O, size_t S, class H>
+    namespace detail {
+        
+        /// Count trailing zeros, x must be non-zero
+        inline unsigned ctz(uint32_t x) {
+        #if defined(__GNUC__)
+            return __builtin_ctz(x);
+        #else
+            unsigned n = 0;
+            for(; (x & 1) == 0; x >>= 1, ++n);
+            return n;
+        #endif
+        }
+        
+        inline unsigned ctz(uint64_t x) {
+        #if defined(__GNUC__)
+            return __builtin_ctzll(x);
+        #else
+            unsigned n = 0;
+            for(; (x & 1) == 0; x >>= 1, ++n);
+            return n;
+        #endif
+        }
+        
+        template <size_t N>
+        template <typename F>
+        void relaxed_bits<N>::
+        for_each_set(size_t first, size_t last, F&& f) const {
+            for(size_t w = first / 64; w*64 < last; ++w) {
+                uint64_t word = words_[w];
+                if(w == first / 64)
+                    word &= ~uint64_t(0) << (first % 64);
+                for(; word != 0; word &= word - 1) {
+                    size_t i = w*64 + ctz(word);
+                    if(i >= last)
+                        return;
+                    f(i);
+                }
+            }
+        }
+        
+        /// Hint to load cache line (for reading)
+        inline void prefetch(void const* ptr) {
+        #if defined(__GNUC__)
+            __builtin_prefetch(ptr);
+        #else
+            (void)ptr;
+        #endif
+        }
+        
+        /// Loads up to 8 bytes as little-endian word, missing bytes are zeros
+        inline uint64_t load_word(unsigned char const* bytes, size_t count) {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes, count < 8 ? count : 8);
+            return word;
+        }
+        
+        /// Accumulates CRC32C (Castagnoli) of 8 bytes of word
+        inline uint32_t crc32c(uint32_t crc, uint64_t word) {
+        #if defined(__SSE4_2__) && defined(__x86_64__)
+            return uint32_t(_mm_crc32_u64(crc, word));
+        #else
+            struct table_t {
+                uint32_t values[256];
+                
+                table_t() {
+                    for(uint32_t byte = 0; byte < 256; ++byte) {
+                        uint32_t crc = byte;
+                        for(int bit = 0; bit < 8; ++bit)
+                            crc = (crc >> 1) ^ (0x82f63b78U & (0U - (crc & 1)));
+                        values[byte] = crc;
+                    }
+                }
+            };
+            static const table_t table;
+            for(int byte = 0; byte < 8; ++byte, word >>= 8)
+                crc = table.values[(crc ^ uint32_t(word)) & 0xff] ^ (crc >> 8);
+            return crc;
+        #endif
+        }
+        
+        /// Reverses bytes order
+        inline uint64_t byteswap(uint64_t x) {
+        #if defined(__GNUC__)
+            return __builtin_bswap64(x);
+        #else
+            x = ((x & 0x00ff00ff00ff00ffUL) << 8)  | ((x >> 8)  & 0x00ff00ff00ff00ffUL);
+            x = ((x & 0x0000ffff0000ffffUL) << 16) | ((x >> 16) & 0x0000ffff0000ffffUL);
+            return (x << 32) | (x >> 32);
+        #endif
+        }
+        
+        /// Folds 128-bit product of a and b to 64 bits
+        inline uint64_t mix(uint64_t a, uint64_t b) {
+            return (a * b) ^ mulhi(a, b); }
+        
+    } // detail
+    
+    template <typename keyT>
+    uint64_t Fibonacci_hash<keyT>::h1(keyT k) {
+        return detail::byteswap(static_cast<uint64_t>(k) * 0x9e3779b97f4a7c15UL); }
+    
+    template <typename keyT>
+    hash_pair CRC32C_hash<keyT>::both(keyT const& k) {
+        auto bytes = reinterpret_cast<unsigned char const*>(&k);
+        uint32_t crc = 0xffffffffU;
+        size_t i = 0;
+        for(; i + 8 <= sizeof(keyT); i += 8)
+            crc = detail::crc32c(crc, detail::load_word(bytes + i, 8));
+        if(i < sizeof(keyT))
+            crc = detail::crc32c(crc, detail::load_word(bytes + i, sizeof(keyT) - i));
+        
+        // Odd multiplier: distinct CRCs give distinct h1, high half feeds h2
+        uint64_t hash = uint64_t(~crc) * 0x9e3779b97f4a7c15UL;
+        return hash_pair{hash, uint32_t(hash >> 32) | 0x1};
+    }
+    
+    template <typename keyT>
+    hash_pair Multiply_mix_hash<keyT>::both(keyT const& k) {
+        const uint64_t P0 = 0xa0761d6478bd642fUL;
+        const uint64_t P1 = 0xe7037ed1a0b428dbUL;
+        const uint64_t P2 = 0x8ebc6af09c88c6e3UL;
+        
+        auto bytes = reinterpret_cast<unsigned char const*>(&k);
+        uint64_t seed = P0;
+        size_t i = 0;
+        for(; i + 16 <= sizeof(keyT); i += 16)
+            seed = detail::mix(detail::load_word(bytes + i, 8) ^ P1,
+                               detail::load_word(bytes + i + 8, 8) ^ seed);
+        if(i < sizeof(keyT)) {
+            size_t rest = sizeof(keyT) - i;
+            seed = detail::mix(detail::load_word(bytes + i, rest) ^ P1,
+                (rest > 8 ? detail::load_word(bytes + i + 8, rest - 8) : 0) ^ seed);
+        }
+        
+        uint64_t hash = detail::mix(seed ^ P2, uint64_t(sizeof(keyT)) ^ P1);
+        return hash_pair{hash, uint32_t(hash >> 32) | 0x1};
+    }
+    
+    // ###################### double_hashing ###################### //
+    
+    template <size_t N>
+    template <typename Eq, typename Count>
+    size_t double_hashing::index<N>::
+    find(hash_pair h, Eq&& eq, Count&& probes) const {
+        sequence seq(h);
+        for(size_t i = 0; i < N; ++i, ++seq) {
+            size_t slot = *seq;
+            ++probes;
+            if(occupied_[slot]) {
+                if(eq(slot))
+                    return slot;
+            } else if(!erased_[slot]) {
+                break; // never used slot terminates sequence
+            }
+        }
+        return npos;
+    }
+    
+    /// Bitsets keep their words inline: hint address is enough
+    template <size_t N>
+    size_t double_hashing::index<N>::
+    prefetch(hash_pair h) const {
+        size_t slot = *sequence(h);
+        detail::prefetch(reinterpret_cast<char const*>(&occupied_) + slot / CHAR_BIT);
+        return slot;
+    }
+    
+    template <size_t N>
+    template <typename Count>
+    size_t double_hashing::index<N>::
+    find_free(hash_pair h, Count&& probes) const {
+        sequence seq(h);
+        for(size_t i = 0; i < N; ++i, ++seq) {
+            size_t slot = *seq;
+            ++probes;
+            if(!occupied_[slot])
+                return slot;
+        }
+        return npos;
+    }
+    
+    template <size_t N>
+    template <typename Eq, typename Count>
+    std::pair<size_t, bool> double_hashing::index<N>::
+    find_or_free(hash_pair h, Eq&& eq, Count&& probes) const {
+        size_t free = npos;
+        sequence seq(h);
+        for(size_t i = 0; i < N; ++i, ++seq) {
+            size_t slot = *seq;
+            ++probes;
+            if(occupied_[slot]) {
+                if(eq(slot))
+                    return {slot, true};
+            } else {
+                if(free == npos)
+                    free = slot;
+                if(!erased_[slot])
+                    break;
+            }
+        }
+        return {free, false};
+    }
+    
+    template <size_t N>
+    template <typename Slots>
+    size_t double_hashing::index<N>::
+    occupy(size_t slot, hash_pair, Slots&&) {
+        occupied_.set(slot);
+        ++size_;
+        if(erased_[slot]) {
+            erased_.reset(slot);
+            --tombstones_;
+        }
+        return slot;
+    }
+    
+    template <size_t N>
+    template <typename Slots>
+    void double_hashing::index<N>::
+    erase(size_t slot, Slots&&) {
+        occupied_.reset(slot);
+        erased_.set(slot);
+        --size_;
+        ++tombstones_;
+        if(size_ == 0 && tombstones_ > N/16) // nothing to skip anymore
+            clear();
+    }
+    
+    template <size_t N>
+    double double_hashing::index<N>::
+    expected_probes(double load, bool hit) {
+        double a = std::min(load, 1.0 - 1.0/N);
+        if(a <= 0)
+            return 1.0;
+        return hit ? std::log(1/(1 - a)) / a : 1/(1 - a);
+    }
+    
+    template <size_t N>
+    void double_hashing::index<N>::
+    clear() {
+        occupied_.reset();
+        erased_.reset();
+        size_ = 0;
+        tombstones_ = 0;
+    }
+    
+    /**
+     * In-place rebuild (same idea as abseil's drop_deleted_without_resize):
+     * every used slot is marked as pending, then each pending element is
+     * placed into the first non-final slot of its probe sequence,
+     * swapping with another pending element if needed.
+     * Pending state is encoded as erased_ bit during the pass.
+     */
+    template <size_t N>
+    template <typename Slots>
+    void double_hashing::index<N>::
+    rehash(Slots&& slots) {
+        auto& pending = erased_;
+        pending.assign(occupied_);
+        occupied_.reset();
+        tombstones_ = 0;
+        
+        for(size_t slot = 0; slot < N; ++slot) {
+            while(pending[slot]) {
+                size_t target = find_free(slots.hash(slot));
+                
+                occupied_.set(target);
+                if(target == slot) {
+                    pending.reset(slot);
+                } else if(pending[target]) {
+                    pending.reset(target);
+                    slots.swap(slot, target);
+                } else {
+                    pending.reset(slot);
+                    slots.move(slot, target);
+                }
+            }
+        }
+    }
+    
+    // ###################### group_probing ###################### //
+    
+#if defined(__SSE2__)
+    /// Group is loaded by two relaxed words, not one vector load: seqlocked writer may change it meanwhile
+    template <size_t N>
+    group_probing::index<N>::group::
+    group(detail::relaxed<int8_t> const* ctrl) {
+        uint64_t words[2];
+        detail::load_relaxed(&words, reinterpret_cast<uint64_t const (*)[2]>(ctrl));
+        ctrl_ = _mm_set_epi64x(int64_t(words[1]), int64_t(words[0]));
+    }
+    
+    template <size_t N>
+    uint32_t group_probing::index<N>::group::
+    match(int8_t tag) const {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl_, _mm_set1_epi8(tag))); }
+    
+    template <size_t N>
+    uint32_t group_probing::index<N>::group::
+    match_empty_or_erased() const {
+        return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(SENTINEL), ctrl_)); }
+    
+    /// Full slots have non-negative tags: sign bits are clear
+    template <size_t N>
+    uint32_t group_probing::index<N>::group::
+    match_full() const {
+        return ~uint32_t(_mm_movemask_epi8(ctrl_)) & 0xffff; }
+#else
+    template <size_t N>
+    group_probing::index<N>::group::
+    group(detail::relaxed<int8_t> const* ctrl) :
+        ctrl_(ctrl) {}
+    
+    template <size_t N>
+    uint32_t group_probing::index<N>::group::
+    match(int8_t tag) const {
+        uint32_t mask = 0;
+        for(size_t i = 0; i < WIDTH; ++i)
+            mask |= uint32_t(ctrl_[i] == tag) << i;
+        return mask;
+    }
+    
+    template <size_t N>
+    uint32_t group_probing::index<N>::group::
+    match_empty_or_erased() const {
+        uint32_t mask = 0;
+        for(size_t i = 0; i < WIDTH; ++i)
+            mask |= uint32_t(ctrl_[i] < SENTINEL) << i;
+        return mask;
+    }
+    
+    template <size_t N>
+    uint32_t group_probing::index<N>::group::
+    match_full() const {
+        uint32_t mask = 0;
+        for(size_t i = 0; i < WIDTH; ++i)
+            mask |= uint32_t(ctrl_[i] >= 0) << i;
+        return mask;
+    }
+#endif
+    
+    template <size_t N>
+    uint32_t group_probing::index<N>::group::
+    match_empty() const {
+        return match(EMPTY); }
+    
+    template <size_t N>
+    group_probing::index<N>::
+    index() {
+        clear(); }
+    
+    template <size_t N>
+    template <typename Eq, typename Count>
+    size_t group_probing::index<N>::
+    find(hash_pair h, Eq&& eq, Count&& probes) const {
+        int8_t tag = tag_of(h);
+        size_t g = group_of(h);
+        for(size_t i = 1; i <= GROUPS; ++i) {
+            group grp(&ctrl_[g*WIDTH]);
+            ++probes;
+            for(uint32_t m = grp.match(tag); m != 0; m &= m - 1) {
+                size_t slot = g*WIDTH + detail::ctz(m);
+                if(eq(slot))
+                    return slot;
+            }
+            if(grp.match_empty())
+                break; // never full group terminates sequence
+            g = next_group(g, i);
+        }
+        return npos;
+    }
+    
+    template <size_t N>
+    size_t group_probing::index<N>::
+    prefetch(hash_pair h) const {
+        size_t slot = group_of(h) * WIDTH;
+        detail::prefetch(&ctrl_[slot]);
+        return slot;
+    }
+    
+    template <size_t N>
+    template <typename Count>
+    size_t group_probing::index<N>::
+    find_free(hash_pair h, Count&& probes) const {
+        size_t g = group_of(h);
+        for(size_t i = 1; i <= GROUPS; ++i) {
+            ++probes;
+            if(uint32_t m = group(&ctrl_[g*WIDTH]).match_empty_or_erased())
+                return g*WIDTH + detail::ctz(m);
+            g = next_group(g, i);
+        }
+        return npos;
+    }
+    
+    template <size_t N>
+    template <typename Eq, typename Count>
+    std::pair<size_t, bool> group_probing::index<N>::
+    find_or_free(hash_pair h, Eq&& eq, Count&& probes) const {
+        int8_t tag = tag_of(h);
+        size_t g = group_of(h);
+        size_t free = npos;
+        for(size_t i = 1; i <= GROUPS; ++i) {
+            group grp(&ctrl_[g*WIDTH]);
+            ++probes;
+            for(uint32_t m = grp.match(tag); m != 0; m &= m - 1) {
+                size_t slot = g*WIDTH + detail::ctz(m);
+                if(eq(slot))
+                    return {slot, true};
+            }
+            if(free == npos)
+                if(uint32_t m = grp.match_empty_or_erased())
+                    free = g*WIDTH + detail::ctz(m);
+            if(grp.match_empty())
+                break;
+            g = next_group(g, i);
+        }
+        return {free, false};
+    }
+    
+    template <size_t N>
+    template <typename Slots>
+    size_t group_probing::index<N>::
+    occupy(size_t slot, hash_pair h, Slots&&) {
+        if(ctrl_[slot] == ERASED)
+            --tombstones_;
+        ctrl_[slot] = tag_of(h);
+        ++size_;
+        return slot;
+    }
+    
+    /// Group having empty slot was never full: no sequence passes through it
+    template <size_t N>
+    template <typename Slots>
+    void group_probing::index<N>::
+    erase(size_t slot, Slots&&) {
+        if(group(&ctrl_[slot / WIDTH * WIDTH]).match_empty()) {
+            ctrl_[slot] = EMPTY;
+        } else {
+            ctrl_[slot] = ERASED;
+            ++tombstones_;
+        }
+        --size_;
+        if(size_ == 0 && tombstones_ > N/16)
+            clear();
+    }
+    
+    template <size_t N>
+    double group_probing::index<N>::
+    expected_probes(double load, bool hit) {
+        double full = std::pow(std::min(load, 1.0), double(WIDTH));
+        double miss = full < 1 ? 1/(1 - full) : double(GROUPS);
+        return hit ? (1 + miss)/2 : miss;
+    }
+    
+    template <size_t N>
+    template <typename F>
+    void group_probing::index<N>::
+    for_each_occupied(size_t first, size_t last, F&& f) const {
+        for(size_t g = first / WIDTH; g*WIDTH < last; ++g) {
+            for(uint32_t m = group(&ctrl_[g*WIDTH]).match_full(); m != 0; m &= m - 1) {
+                size_t slot = g*WIDTH + detail::ctz(m);
+                if(slot >= last)
+                    return;
+                if(slot >= first)
+                    f(slot);
+            }
+        }
+    }
+    
+    template <size_t N>
+    void group_probing::index<N>::
+    clear() {
+        for(size_t slot = 0; slot < ctrl_.size(); ++slot)
+            ctrl_[slot] = slot < N ? int8_t(EMPTY) : int8_t(SENTINEL);
+        size_ = 0;
+        tombstones_ = 0;
+    }
+    
+    /**
+     * Same as double_hashing::index::rehash(), but full slots are marked
+     * as pending with ERASED, elements stay in place if target slot
+     * belongs to the same group.
+     */
+    template <size_t N>
+    template <typename Slots>
+    void group_probing::index<N>::
+    rehash(Slots&& slots) {
+        for(size_t slot = 0; slot < N; ++slot)
+            ctrl_[slot] = ctrl_[slot] >= 0 ? int8_t(ERASED) : int8_t(EMPTY);
+        tombstones_ = 0;
+        
+        for(size_t slot = 0; slot < N; ++slot) {
+            while(ctrl_[slot] == ERASED) {
+                hash_pair h = slots.hash(slot);
+                size_t target = find_free(h);
+                
+                if(target / WIDTH == slot / WIDTH) {
+                    ctrl_[slot] = tag_of(h);
+                } else if(ctrl_[target] == ERASED) {
+                    ctrl_[target] = tag_of(h);
+                    slots.swap(slot, target);
+                } else {
+                    ctrl_[target] = tag_of(h);
+                    ctrl_[slot] = EMPTY;
+                    slots.move(slot, target);
+                }
+            }
+        }
+    }
+    
+    // ###################### robin_hood ###################### //
+    
+    template <size_t N>
+    robin_hood::index<N>::
+    index() : size_(0) {
+        clear();
+    }
+    
+    template <size_t N>
+    template <typename Eq, typename Count>
+    size_t robin_hood::index<N>::
+    find(hash_pair h, Eq&& eq, Count&& probes) const {
+        size_t slot = home_of(h);
+        for(size_t d = 1; d <= MAX_DISTANCE; ++d, slot = next(slot)) {
+            ++probes;
+            size_t distance = distance_[slot];
+            if(distance < d)
+                break; // key would have displaced this one
+            if(distance == d && eq(slot))
+                return slot;
+        }
+        return npos;
+    }
+    
+    template <size_t N>
+    size_t robin_hood::index<N>::
+    prefetch(hash_pair h) const {
+        size_t slot = home_of(h);
+        detail::prefetch(&distance_[slot]);
+        return slot;
+    }
+    
+    template <size_t N>
+    size_t robin_hood::index<N>::
+    position_of(hash_pair h, size_t& distance) const {
+        size_t slot = home_of(h);
+        for(distance = 1; distance_[slot] >= distance; ++distance)
+            slot = next(slot);
+        return slot;
+    }
+    
+    template <size_t N>
+    template <typename Count>
+    size_t robin_hood::index<N>::
+    find_free(hash_pair h, Count&& probes) const {
+        if(size_ == N)
+            return npos;
+        
+        size_t distance;
+        size_t slot = position_of(h, distance);
+        probes += distance;
+        if(distance > MAX_DISTANCE)
+            return npos;
+        
+        // Rest of cluster is shifted by one slot
+        for(; distance_[slot] != 0; ++probes, slot = next(slot))
+            if(distance_[slot] == MAX_DISTANCE)
+                return npos;
+        return slot;
+    }
+    
+    template <size_t N>
+    template <typename Eq, typename Count>
+    std::pair<size_t, bool> robin_hood::index<N>::
+    find_or_free(hash_pair h, Eq&& eq, Count&& probes) const {
+        size_t slot = home_of(h);
+        size_t distance = 1;
+        for(; ++probes, distance_[slot] >= distance; ++distance, slot = next(slot))
+            if(distance_[slot] == distance && eq(slot))
+                return {slot, true};
+        
+        // Miss stopped at key's position, free slot ends its cluster
+        if(size_ == N || distance > MAX_DISTANCE)
+            return {npos, false};
+        for(; distance_[slot] != 0; ++probes, slot = next(slot))
+            if(distance_[slot] == MAX_DISTANCE)
+                return {npos, false};
+        return {slot, false};
+    }
+    
+    template <size_t N>
+    template <typename Slots>
+    size_t robin_hood::index<N>::
+    occupy(size_t slot, hash_pair h, Slots&& slots) {
+        size_t distance;
+        size_t target = position_of(h, distance);
+        for(size_t s = slot; s != target; s = prev(s)) {
+            slots.swap(prev(s), s);
+            distance_[s] = uint8_t(distance_[prev(s)] + 1);
+        }
+        distance_[target] = uint8_t(distance);
+        ++size_;
+        return target;
+    }
+    
+    template <size_t N>
+    template <typename Slots>
+    void robin_hood::index<N>::
+    erase(size_t slot, Slots&& slots) {
+        distance_[slot] = 0;
+        --size_;
+        for(size_t s = next(slot); distance_[s] > 1; slot = s, s = next(s)) {
+            slots.move(s, slot);
+            distance_[slot] = uint8_t(distance_[s] - 1);
+            distance_[s] = 0;
+        }
+    }
+    
+    template <size_t N>
+    double robin_hood::index<N>::
+    expected_probes(double load, bool hit) {
+        double a = std::min(load, 1.0 - 1.0/N);
+        return hit ? (1 + 1/(1 - a))/2 : (1 + 1/((1 - a)*(1 - a)))/2;
+    }
+    
+    template <size_t N>
+    template <typename F>
+    void robin_hood::index<N>::
+    for_each_occupied(size_t first, size_t last, F&& f) const {
+        for(size_t slot = first; slot < last; ) {
+            if(slot + 8 <= last && detail::load_word(reinterpret_cast<unsigned char const*>(&distance_[slot]), 8) == 0) {
+                slot += 8;
+                continue;
+            }
+            if(distance_[slot] != 0)
+                f(slot);
+            ++slot;
+        }
+    }
+    
+    template <size_t N>
+    void robin_hood::index<N>::
+    clear() {
+        for(auto& distance : distance_)
+            distance = 0;
+        size_ = 0;
+    }
+    
+    // ###################### Layouts ###################### //
+    
+    template <size_t A>
+    template <typename V, typename O, size_t N>
+    void interleaved<A>::storage<V,O,N>::
+    prefetch_probe(size_t idx) const {
+        detail::prefetch(&cells[idx]);
+    }
+    
+    /// Large cells take several lines: all of them are requested
+    template <size_t A>
+    template <typename V, typename O, size_t N>
+    void interleaved<A>::storage<V,O,N>::
+    prefetch(cell_t const* cell) const {
+        for(size_t line = 0; line < sizeof(cell_t); line += 64)
+            detail::prefetch(reinterpret_cast<char const*>(cell) + line);
+    }
+    
+    /// Probe reads fingerprint, value is loaded on its match only
+    template <size_t A>
+    template <typename V, typename O, size_t N>
+    void split<A>::storage<V,O,N>::
+    prefetch_probe(size_t idx) const {
+        detail::prefetch(&fingerprints[idx]);
+    }
+    
+    template <size_t A>
+    template <typename V, typename O, size_t N>
+    void split<A>::storage<V,O,N>::
+    prefetch(cell_t const* cell) const {
+        detail::prefetch(cell);
+        auto value = reinterpret_cast<char const*>(&values[cell - cells.data()]);
+        for(size_t line = 0; line < sizeof(V); line += 64)
+            detail::prefetch(value + line);
+    }
+    
+    // ###################### hashlist ###################### //
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
     template <typename... Args>
-    auto hashlist<K,O,S,H>::
+    auto hashlist<K,O,S,H,P,T,L>::
     emplace_back(key_type const& key, Args&&... args) -> iterator {
-        auto H1 = hasher::h1(key);
-        auto H2 = hasher::h2(key);
-        auto& sentinel = cells_[0];
-        auto& h = header_;
-        auto& cs = cells_;
-        for(size_t i = 0; i < SIZE; ++i) {
-            size_t bit = (H1 + i*H2) % SIZE;
-            if(!h[bit]) {
-                size_t idx = 1 + bit;
-                auto& inserted = cs[idx];
-                new(&inserted.value()) value_type(key, std::forward<Args>(args)...);
-                h.flip(bit);
-                
-                offset_t sidx(idx);
-                inserted.next_offset = -sidx;
-                inserted.prev_offset = sentinel.prev_offset - sidx;
-                cs[sentinel.prev_offset].next_offset = -inserted.prev_offset;
-                sentinel.prev_offset = sidx;
-                return --end();
+        auto hk = hash(key);
+        probes_t probes{};
+        size_t slot = header_.find_free(hk, probes);
+        if(slot == index_t::npos) {
+            stats().on_insert_failure();
+            throw std::bad_alloc{};
+        }
+        auto inserted = construct_back(slot, hk, key, std::forward<Args>(args)...);
+        stats().on_insert(probes, size());
+        return inserted;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename... Args>
+    auto hashlist<K,O,S,H,P,T,L>::
+    try_emplace_back(key_type const& key, Args&&... args) -> std::pair<iterator, bool> {
+        auto hk = hash(key);
+        auto& st = store_;
+        probes_t probes{};
+        auto found = header_.find_or_free(hk, [&](size_t s) {
+            return st.may_hold(1 + s, hk) && holds_key(&st.cells[1 + s], key); }, probes);
+        if(found.second) {
+            stats().on_find(probes, true);
+            return {make_iterator(&st.cells[1 + found.first]), false};
+        }
+        if(found.first == index_t::npos) {
+            stats().on_insert_failure();
+            return {end(), false};
+        }
+        auto inserted = construct_back(found.first, hk, key, std::forward<Args>(args)...);
+        stats().on_insert(probes, size());
+        return {inserted, true};
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename M>
+    auto hashlist<K,O,S,H,P,T,L>::
+    insert_or_assign(key_type const& key, M&& obj) -> std::pair<iterator, bool> {
+        auto result = try_emplace_back(key, std::forward<M>(obj));
+        if(!result.second && result.first != end())
+            assign_mapped(result.first->second, std::forward<M>(obj), // wasn't moved from
+                std::integral_constant<bool, TRIVIAL>());
+        return result;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    auto hashlist<K,O,S,H,P,T,L>::
+    operator[](key_type const& key) -> mapped_type& {
+        auto result = try_emplace_back(key);
+        if(result.first == end())
+            throw std::bad_alloc{};
+        return result.first->second;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    auto hashlist<K,O,S,H,P,T,L>::
+    erase(key_type const& key) -> size_type {
+        auto found = find(key);
+        if(found == end())
+            return 0;
+        erase(found);
+        return 1;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename... Args>
+    auto hashlist<K,O,S,H,P,T,L>::
+    construct_back(size_t slot, hash_pair hk, key_type const& key, Args&&... args) -> iterator {
+        auto& cs = store_.cells;
+        auto& sentinel = cs[0];
+        size_t idx = 1 + slot;
+        auto& inserted = cs[idx];
+        construct_value(&inserted, key, std::forward<Args>(args)...);
+        store_.set_fingerprint(idx, hk);
+        
+        offset_t sidx(idx);
+        inserted.next_offset = -sidx;
+        inserted.prev_offset = sentinel.prev_offset - sidx;
+        cs[sentinel.prev_offset].next_offset = -inserted.prev_offset;
+        sentinel.prev_offset = sidx;
+        
+        // Linked already: policy may relocate it
+        header_.occupy(slot, hk, slots_t(*this));
+        return --end();
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename... Args>
+    auto hashlist<K,O,S,H,P,T,L>::
+    construct_after(cell_t* tail, size_t slot, hash_pair hk, key_type const& key, Args&&... args) -> cell_t* {
+        size_t idx = 1 + slot;
+        cell_t* cell = &store_.cells[idx];
+        construct_value(cell, key, std::forward<Args>(args)...);
+        store_.set_fingerprint(idx, hk);
+        
+        cell->prev_offset = tail - cell;
+        tail->next_offset = cell - tail;
+        header_.occupy(slot, hk, slots_t(*this));
+        return cell;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename ForwardIt>
+    size_t hashlist<K,O,S,H,P,T,L>::
+    prepare_block(ForwardIt& it, ForwardIt last, std::array<hash_pair, BATCH>& hashes) const {
+        size_t count = 0;
+        for(; count < BATCH && it != last; ++count, ++it)
+            hashes[count] = hash(it->first);
+        for(size_t i = 0; i < count; ++i)
+            store_.prefetch(&store_.cells[1 + header_.prefetch(hashes[i])]);
+        return count;
+    }
+    
+    /**
+     * Blocks are pipelined: the next one is hashed and prefetched before
+     * the current one is placed, so its lines arrive meanwhile.
+     * Displacing index relocates linked cells: such elements are linked one by one.
+     */
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename ForwardIt>
+    ForwardIt hashlist<K,O,S,H,P,T,L>::
+    emplace_back_range(ForwardIt first, ForwardIt last) {
+        std::array<hash_pair, BATCH> blocks[2];
+        ForwardIt ahead = first;
+        size_t count = prepare_block(ahead, last, blocks[0]);
+        for(size_t current = 0; count != 0; current ^= 1) {
+            size_t next = prepare_block(ahead, last, blocks[current ^ 1]);
+            
+            // Stable index lets cells of block be chained
+            auto const& hashes = blocks[current];
+            cell_t* tail = store_.cells.data() + store_.cells[0].prev_offset;
+            try {
+                for(size_t i = 0; i < count; ++i, ++first) {
+                    probes_t probes{};
+                    size_t slot = header_.find_free(hashes[i], probes);
+                    if(slot == index_t::npos) {
+                        stats().on_insert_failure();
+                        if(index_t::STABLE)
+                            close_chain(tail);
+                        return first;
+                    }
+                    if(index_t::STABLE)
+                        tail = construct_after(tail, slot, hashes[i], first->first, first->second);
+                    else
+                        construct_back(slot, hashes[i], first->first, first->second);
+                    stats().on_insert(probes, size());
+                }
+            } catch(...) {
+                if(index_t::STABLE)
+                    close_chain(tail);
+                throw;
             }
+            if(index_t::STABLE)
+                close_chain(tail);
+            count = next;
         }
-        throw std::bad_alloc{};
+        return first;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    auto hashlist<K,O,S,H,P,T,L>::
+    find_cell(key_type const& key, hash_pair hk) const -> cell_t const* {
+        auto const& st = store_;
+        probes_t probes{};
+        size_t slot = header_.find(hk, [&](size_t s) {
+            return st.may_hold(1 + s, hk) && holds_key(&st.cells[1 + s], key); }, probes);
+        stats().on_find(probes, slot != index_t::npos);
+        return &st.cells[slot == index_t::npos ? 0 : 1 + slot];
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename F>
+    auto hashlist<K,O,S,H,P,T,L>::
+    visit_equal(key_type const& key, F&& f) const -> size_type {
+        auto const& st = store_;
+        auto hk = hash(key);
+        size_type found = 0;
+        probes_t probes{};
+        
+        // Never matching eq: walk goes on to the end of key's probe sequence
+        header_.find(hk, [&](size_t s) {
+            if(st.may_hold(1 + s, hk) && holds_key(&st.cells[1 + s], key)) {
+                f(&st.cells[1 + s]);
+                ++found;
+            }
+            return false;
+        }, probes);
+        stats().on_find(probes, found != 0);
+        return found;
     }
     
-    template <typename K, typename O, size_t S, class H>
-    auto hashlist<K,O,S,H>::
-    find_cell(key_type const& key) const -> cell_t const* {
-        auto H1 = hasher::h1(key);
-        auto H2 = hasher::h2(key);
-        auto const& h = header_;
-        auto const& cs = cells_;
-        for(size_t i = 0; i < SIZE; ++i) {
-            size_t bit = (H1 + i*H2) % SIZE;
-            size_t idx = 1 + bit;
-            auto const& c = cs[idx];
-            if(h[bit] && c.value().first == key)
-                return &c;
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename ForwardIt, typename F>
+    void hashlist<K,O,S,H,P,T,L>::
+    find_batch_impl(ForwardIt first, ForwardIt last, F&& found) const {
+        std::array<hash_pair, BATCH> hashes;
+        while(first != last) {
+            // Stage 1: hash block and prefetch first probed slots
+            size_t count = 0;
+            ForwardIt block = first;
+            for(; count < BATCH && first != last; ++count, ++first) {
+                hashes[count] = hash(*first);
+                size_t slot = header_.prefetch(hashes[count]);
+                store_.prefetch_probe(1 + slot);
+            }
+            
+            // Stage 2: probe, lines are (being) loaded
+            for(size_t i = 0; i < count; ++i, ++block)
+                found(find_cell(*block, hashes[i]));
         }
-        return &cs[0];
     }
     
-    template <typename K, typename O, size_t S, class H>
-    auto hashlist<K,O,S,H>::
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt hashlist<K,O,S,H,P,T,L>::
+    find_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+        find_batch_impl(first, last, [this, &out](cell_t const* cell) {
+            *out++ = make_iterator(cell); });
+        return out;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt hashlist<K,O,S,H,P,T,L>::
+    find_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+        find_batch_impl(first, last, [this, &out](cell_t const* cell) {
+            *out++ = make_iterator(const_cast<cell_t*>(cell)); });
+        return out;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    auto hashlist<K,O,S,H,P,T,L>::
     remove_cell(cell_t* cell) -> cell_t* {
-        auto& cs = cells_;
+        auto& cs = store_.cells;
         size_t idx = cell - cs.begin();
-        size_t bit = idx - 1;
         
-        header_[bit] = false;
-        cell->value().~value_type();
+        store_.value(cell).~value_type();
+        unlink_cell(cell);
         
+        // Following cell may be relocated by policy
+        slots_t slots(*this, cell + cell->next_offset);
+        header_.erase(idx - 1, slots);
+        stats().on_erase(header_.tombstones());
+        return slots.tracked();
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    unlink_cell(cell_t* cell) {
         (cell + cell->prev_offset)->next_offset += cell->next_offset;
         (cell + cell->next_offset)->prev_offset += cell->prev_offset;
-        return (cell + cell->next_offset);
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    link_before(cell_t* cell, cell_t* pos) {
+        cell_t* prev = pos + pos->prev_offset;
+        cell->prev_offset = prev - cell;
+        cell->next_offset = pos - cell;
+        prev->next_offset = cell - prev;
+        pos->prev_offset = cell - pos;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    auto hashlist<K,O,S,H,P,T,L>::
+    erase(const_iterator first, const_iterator last) -> iterator {
+        auto from = const_cast<cell_t*>(first.ptr_);
+        auto to   = const_cast<cell_t*>(last.ptr_);
+        if(first == cbegin() && last == cend()) {
+            clear();
+            return end();
+        }
+        
+        // Relocations would follow stale links of detached range
+        if(!index_t::STABLE) {
+            for(auto count = std::distance(first, last); count > 0; --count)
+                from = remove_cell(from);
+            return make_iterator(from);
+        }
+        
+        cell_t* prev = from + from->prev_offset;
+        prev->next_offset = to - prev;
+        to->prev_offset = prev - to;
+        
+        auto& cs = store_.cells;
+        for(cell_t* cell = from; cell != to; cell += cell->next_offset) {
+            store_.value(cell).~value_type();
+            header_.erase(size_t(cell - cs.begin()) - 1, slots_t(*this));
+            stats().on_erase(header_.tombstones());
+        }
+        return make_iterator(to);
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    pop_front(size_type n) {
+        if(n >= size()) {
+            clear();
+            return;
+        }
+        auto last = cbegin();
+        std::advance(last, n);
+        erase(cbegin(), last);
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    destroy_all(std::false_type) {
+        for(auto& p : *this)
+            p.~value_type();
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    move_to_back(const_iterator pos) {
+        auto cell = const_cast<cell_t*>(pos.ptr_);
+        unlink_cell(cell);
+        link_before(cell, &store_.cells[0]);
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    move_to_front(const_iterator pos) {
+        auto cell = const_cast<cell_t*>(pos.ptr_);
+        unlink_cell(cell);
+        link_before(cell, &store_.cells[store_.cells[0].next_offset]);
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    move_cell(cell_t* from, cell_t* to) {
+        cell_t* prev = from + from->prev_offset;
+        cell_t* next = from + from->next_offset;
+        
+        construct_moved(to, std::move(store_.value(from)), std::integral_constant<bool, TRIVIAL>());
+        store_.value(from).~value_type();
+        store_.move_fingerprint(from - store_.cells.data(), to - store_.cells.data());
+        
+        to->prev_offset = prev - to;
+        to->next_offset = next - to;
+        prev->next_offset = to - prev;
+        next->prev_offset = to - next;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    swap_cells(cell_t* a, cell_t* b) {
+        {
+            value_type temp(std::move(store_.value(a)));
+            store_.value(a).~value_type();
+            construct_moved(a, std::move(store_.value(b)), std::integral_constant<bool, TRIVIAL>());
+            store_.value(b).~value_type();
+            construct_moved(b, std::move(temp), std::integral_constant<bool, TRIVIAL>());
+        }
+        store_.swap_fingerprints(a - store_.cells.data(), b - store_.cells.data());
+        
+        // Exchanges a and b in absolute links
+        auto swapped = [a, b](cell_t* c) -> cell_t* {
+            return c == a ? b : (c == b ? a : c); };
+        
+        cell_t* const neighbours[4] = {
+            a + a->prev_offset, a + a->next_offset,
+            b + b->prev_offset, b + b->next_offset
+        };
+        
+        cell_t* const a_prev = swapped(neighbours[2]);
+        cell_t* const a_next = swapped(neighbours[3]);
+        cell_t* const b_prev = swapped(neighbours[0]);
+        cell_t* const b_next = swapped(neighbours[1]);
+        
+        for(size_t i = 0; i < 4; ++i) {
+            cell_t* c = neighbours[i];
+            if(c == a || c == b || std::find(neighbours, neighbours + i, c) != neighbours + i)
+                continue;
+            cell_t* c_prev = c + c->prev_offset;
+            cell_t* c_next = c + c->next_offset;
+            c->prev_offset = swapped(c_prev) - c;
+            c->next_offset = swapped(c_next) - c;
+        }
+        
+        a->prev_offset = a_prev - a;
+        a->next_offset = a_next - a;
+        b->prev_offset = b_prev - b;
+        b->next_offset = b_next - b;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    uint64_t hashlist<K,O,S,H,P,T,L>::
+    layout_fingerprint() {
+        uint64_t hash = 0xcbf29ce484222325UL;
+        auto mix = [&hash](uint64_t value) {
+            for(size_t byte = 0; byte < sizeof(value); ++byte, value >>= CHAR_BIT) {
+                hash ^= value & 0xFF;
+                hash *= 0x100000001b3UL;
+            }
+        };
+        
+        for(char const* c = typeid(hashlist).name(); *c != '\0'; ++c)
+            mix(static_cast<unsigned char>(*c));
+        mix(sizeof(hashlist));
+        mix(alignof(hashlist));
+        mix(sizeof(value_type));
+        mix(alignof(value_type));
+        mix(SIZE);
+        return hash;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    forget() {
+        header_.clear();
+        store_.cells[0].next_offset = 0;
+        store_.cells[0].prev_offset = 0;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    copy_from(hashlist const& other, std::true_type) {
+        static_cast<T&>(*this) = other;
+        header_ = other.header_;
+        std::memcpy(static_cast<void*>(&store_), &other.store_, sizeof(store_)); // free cells are uninitialized
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    copy_relaxed(hashlist const& other) {
+        static_assert(TRIVIAL, LOG_HEAD "relaxed copies require trivially copyable keys and values");
+        
+        static_cast<T&>(*this) = other;
+        detail::load_relaxed(&header_, &other.header_);
+        detail::load_relaxed(&store_, &other.store_);
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    copy_from(hashlist const& other, std::false_type) {
+        clear();
+        take_cells(other, [&other](cell_t const* cell) -> value_type const& {
+            return other.store_.value(cell); });
+        static_cast<T&>(*this) = other;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    move_from(hashlist& other, std::true_type trivial) {
+        copy_from(other, trivial);
+        other.forget();
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    move_from(hashlist& other, std::false_type) {
+        clear();
+        take_cells(other, [&other](cell_t const* cell) -> value_type&& {
+            return std::move(other.store_.value(cell)); });
+        static_cast<T&>(*this) = other;
+        other.clear();
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename Value>
+    void hashlist<K,O,S,H,P,T,L>::
+    take_cells(hashlist const& other, Value&& value) {
+        cell_t const* sentinel = other.store_.cells.data();
+        cell_t const* cell = sentinel + sentinel->next_offset;
+        try {
+            for(; cell != sentinel; cell += cell->next_offset) {
+                new(&store_.value(&store_.cells[cell - sentinel])) value_type(value(cell));
+                store_.copy_fingerprint(other.store_, cell - sentinel);
+            }
+        } catch(...) {
+            for(cell_t const* c = sentinel + sentinel->next_offset; c != cell; c += c->next_offset)
+                store_.value(&store_.cells[c - sentinel]).~value_type();
+            throw;
+        }
+        
+        // All elements are in place: index and links become valid
+        header_ = other.header_;
+        cell = sentinel;
+        do {
+            auto& own = store_.cells[cell - sentinel];
+            own.next_offset = cell->next_offset;
+            own.prev_offset = cell->prev_offset;
+            cell += cell->next_offset;
+        } while(cell != sentinel);
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    snapshot_header hashlist<K,O,S,H,P,T,L>::
+    make_snapshot_header() const {
+        snapshot_header header{};
+        header.magic        = snapshot_header::MAGIC;
+        header.version      = snapshot_header::VERSION;
+        header.fingerprint  = layout_fingerprint();
+        header.size         = sizeof(header_) + sizeof(store_);
+        return header;
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    check_snapshot_header(snapshot_header const& header) {
+        if(header.magic != snapshot_header::MAGIC || header.version != snapshot_header::VERSION)
+            throw std::runtime_error(LOG_HEAD "data isn't a hashlist snapshot");
+        if(header.fingerprint != layout_fingerprint() || header.size != sizeof(header_) + sizeof(store_))
+            throw std::runtime_error(LOG_HEAD "hashlist snapshot layout mismatch");
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    save(std::ostream& out) const {
+        static_assert(TRIVIAL, LOG_HEAD "snapshots require trivially copyable keys and values");
+        
+        auto header = make_snapshot_header();
+        out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        out.write(reinterpret_cast<char const*>(&header_), sizeof(header_));
+        out.write(reinterpret_cast<char const*>(&store_), sizeof(store_));
+        if(!out)
+            throw std::runtime_error(LOG_HEAD "can't write hashlist snapshot");
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    load(std::istream& in) {
+        static_assert(TRIVIAL, LOG_HEAD "snapshots require trivially copyable keys and values");
+        
+        forget();
+        snapshot_header header;
+        if(!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+            throw std::runtime_error(LOG_HEAD "can't read hashlist snapshot");
+        check_snapshot_header(header);
+        
+        in.read(reinterpret_cast<char*>(&header_), sizeof(header_));
+        in.read(reinterpret_cast<char*>(&store_), sizeof(store_));
+        if(!in) {
+            forget();
+            throw std::runtime_error(LOG_HEAD "hashlist snapshot is truncated");
+        }
+    }
+    
+#if defined(__unix__) || defined(__APPLE__)
+    namespace detail {
+        
+        /// Writes whole buffer retrying partial writes, @throws std::system_error
+        inline void write_all(int fd, void const* data, size_t length) {
+            auto bytes = static_cast<char const*>(data);
+            while(length > 0) {
+                ssize_t written = ::write(fd, bytes, length);
+                if(written < 0 && errno == EINTR)
+                    continue;
+                if(written <= 0)
+                    throw std::system_error(errno, std::system_category(),
+                        LOG_HEAD "can't write hashlist snapshot");
+                bytes  += written;
+                length -= size_t(written);
+            }
+        }
+        
+        /// Reads whole buffer, @returns false on premature end of file, @throws std::system_error
+        inline bool read_all(int fd, void* data, size_t length) {
+            auto bytes = static_cast<char*>(data);
+            while(length > 0) {
+                ssize_t got = ::read(fd, bytes, length);
+                if(got < 0 && errno == EINTR)
+                    continue;
+                if(got < 0)
+                    throw std::system_error(errno, std::system_category(),
+                        LOG_HEAD "can't read hashlist snapshot");
+                if(got == 0)
+                    return false;
+                bytes  += got;
+                length -= size_t(got);
+            }
+            return true;
+        }
+        
+    } // detail
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    save(int fd) const {
+        static_assert(TRIVIAL, LOG_HEAD "snapshots require trivially copyable keys and values");
+        
+        auto header = make_snapshot_header();
+        detail::write_all(fd, &header, sizeof(header));
+        detail::write_all(fd, &header_, sizeof(header_));
+        detail::write_all(fd, &store_, sizeof(store_));
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    load(int fd) {
+        static_assert(TRIVIAL, LOG_HEAD "snapshots require trivially copyable keys and values");
+        
+        forget();
+        snapshot_header header;
+        if(!detail::read_all(fd, &header, sizeof(header)))
+            throw std::runtime_error(LOG_HEAD "can't read hashlist snapshot");
+        check_snapshot_header(header);
+        
+        try {
+            if(!detail::read_all(fd, &header_, sizeof(header_)) ||
+               !detail::read_all(fd, &store_, sizeof(store_)))
+                throw std::runtime_error(LOG_HEAD "hashlist snapshot is truncated");
+        } catch(...) {
+            forget();
+            throw;
+        }
+    }
+#endif
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    rehash() {
+        header_.rehash(slots_t(*this));
+        stats().on_rehash();
+    }
+    
+    /**
+     * Index is rebuilt from scratch while list is walked: free cells
+     * are marked by zero next_offset (used cells never link to themselves),
+     * so target cell either is free or holds element not placed yet,
+     * which is swapped into current one and is placed later.
+     */
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    void hashlist<K,O,S,H,P,T,L>::
+    compact() {
+        if(!index_t::STABLE)
+            return;
+        
+        for(size_t slot = 0; slot < S; ++slot)
+            if(!header_.occupied(slot))
+                store_.cells[1 + slot].next_offset = 0;
+        header_.clear();
+        
+        cell_t* const sentinel = store_.cells.data();
+        for(cell_t* cell = sentinel + sentinel->next_offset; cell != sentinel; cell += cell->next_offset) {
+            hash_pair hk = hash(store_.value(cell).first);
+            size_t target = header_.find_free(hk);
+            cell_t* to = &store_.cells[1 + target];
+            if(to != cell) {
+                if(to->next_offset == 0) {
+                    move_cell(cell, to);
+                    cell->next_offset = 0;
+                } else {
+                    swap_cells(cell, to);
+                }
+                cell = to;
+            }
+            header_.occupy(target, hk, slots_t(*this));
+        }
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    template <typename Store, typename F>
+    void hashlist<K,O,S,H,P,T,L>::
+    walk_prefetched(Store& store, F&& f) {
+        auto sentinel = store.cells.data();
+        
+        // Scout runs ahead: its loads overlap with f's work
+        auto scout = sentinel + sentinel->next_offset;
+        for(size_t i = 0; i < PREFETCH_AHEAD && scout != sentinel; ++i) {
+            store.prefetch(scout);
+            scout += scout->next_offset;
+        }
+        for(auto cell = sentinel + sentinel->next_offset; cell != sentinel; cell += cell->next_offset) {
+            if(scout != sentinel) {
+                store.prefetch(scout);
+                scout += scout->next_offset;
+            }
+            f(store.value(cell));
+        }
+    }
+    
+    template <typename K, typename O, size_t S, class H, class P, class T, class L>
+    table_diagnostics hashlist<K,O,S,H,P,T,L>::
+    diagnostics(size_t miss_samples) const {
+        table_diagnostics d{};
+        d.capacity   = S;
+        d.size       = size();
+        d.tombstones = tombstones();
+        
+        // Clusters may wrap around: walk starts after a free slot (if any)
+        auto add_cluster = [&d](size_t length) {
+            size_t bucket = 0;
+            for(size_t l = length; l > 1 && bucket < table_diagnostics::BUCKETS - 1; l >>= 1)
+                ++bucket;
+            ++d.clusters[bucket];
+            ++d.cluster_count;
+            d.max_cluster = std::max(d.max_cluster, length);
+        };
+        size_t start = 0;
+        while(start < S && header_.occupied(start))
+            ++start;
+        size_t run = 0;
+        for(size_t i = 1; i <= S; ++i) {
+            if(header_.occupied((start + i) % S)) {
+                ++run;
+            } else if(run != 0) {
+                add_cluster(run);
+                run = 0;
+            }
+        }
+        if(run != 0)
+            add_cluster(run);
+        d.mean_cluster = d.cluster_count == 0 ? 0.0 : 1.0 * d.size / d.cluster_count;
+        
+        // Every element is looked up by its own slot: duplicated keys are measured too
+        size_t hit_probes = 0;
+        for(auto it = begin(), e = end(); it != e; ++it) {
+            size_t slot = offset_of_element(it) - 1;
+            header_.find(hash(it->first), [slot](size_t s) { return s == slot; }, hit_probes);
+        }
+        d.hit_probes = d.size == 0 ? 0.0 : 1.0 * hit_probes / d.size;
+        
+        // Fixed seed: diagnostics of equal tables are equal
+        size_t miss_probes = 0;
+        uint64_t seed = 0x9e3779b97f4a7c15UL;
+        for(size_t i = 0; i < miss_samples; ++i) {
+            uint64_t h = (seed += 0x9e3779b97f4a7c15UL);
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9UL;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebUL;
+            h ^= h >> 31;
+            header_.find(hash_pair{h, uint32_t(h >> 32) | 0x1}, [](size_t) { return false; }, miss_probes);
+        }
+        d.miss_probes = miss_samples == 0 ? 0.0 : 1.0 * miss_probes / miss_samples;
+        
+        double load = 1.0 * (d.size + d.tombstones) / S;
+        d.expected_hit_probes  = index_t::expected_probes(load, true);
+        d.expected_miss_probes = index_t::expected_probes(load, false);
+        return d;
     }
     
 } // hl
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include <ax.hashlist.hpp>
+
+#define LOG_HEAD "[hl]: "
+
+namespace ax { namespace hl {
+    
+    /**
+     * Fixed-size LRU cache: hashlist ordered from least to most
+     * recently used, hit relinks element to the back, insertion into
+     * full cache evicts front(). No allocations, standard layout
+     * if hashlist is (may be placed into shared memory, see hl::shared).
+     * Pointers and iterators to values stay valid until their eviction
+     * or erasure: put() never rehashes, tombstones left by erasures and
+     * evictions are dropped by explicit rehash() only (unless Probe
+     * relocates elements on insertion and erasure, e.g. robin_hood).
+     * @arg N - capacity
+     */
+    template <
+        typename keyT,
+        typename objT,
+        size_t N,
+        class Hash = default_hash<keyT>,
+        class Probe = double_hashing
+    > class lru_cache {
+    public:
+        using container_type = hashlist<keyT, objT, N, Hash, Probe>;
+        using key_type       = keyT;
+        using mapped_type    = objT;
+        using size_type      = size_t;
+        using iterator       = typename container_type::iterator;
+        using const_iterator = typename container_type::const_iterator;
+        
+        struct counters {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+        };
+        
+        lru_cache() : stats_{0, 0, 0} {}
+        
+        static constexpr size_type capacity() { return N; }
+        
+        size_type size() const { return list_.size(); }
+        
+        bool empty() const { return list_.empty(); }
+        
+        /// @returns pointer to value of key marked as most recently used, nullptr on miss
+        mapped_type* get(key_type const& key);
+        
+        /// Looks up without touching recency and counters
+        mapped_type const* peek(key_type const& key) const {
+            auto found = list_.find(key);
+            return found == list_.end() ? nullptr : &found->second;
+        }
+        
+        /**
+         * Assigns value to key or inserts it evicting least recently used
+         * elements if needed, key becomes most recently used.
+         * @returns reference to stored value
+         */
+        template <typename M>
+        mapped_type& put(key_type const& key, M&& obj);
+        
+        /// @returns number of erased elements
+        size_type erase(key_type const& key) {
+            return list_.erase(key); }
+        
+        /// Drops elements, counters are kept
+        void clear() { list_.clear(); }
+        
+        /// @returns true if tombstones occupy most of free slots (see hashlist::wants_rehash())
+        bool wants_rehash() const { return list_.wants_rehash(); }
+        
+        /// Drops tombstones: invalidates all pointers and iterators
+        void rehash() { list_.rehash(); }
+        
+        counters stats() const { return stats_; }
+        
+        void reset_stats() { stats_ = counters{0, 0, 0}; }
+        
+        /// Iteration from least to most recently used
+        const_iterator begin()  const { return list_.begin(); }
+        const_iterator end()    const { return list_.end(); }
+        
+        container_type const& container() const { return list_; }
+        
+        static uint64_t layout_fingerprint() {
+            return container_type::layout_fingerprint() ^ (sizeof(lru_cache) * 0x9e3779b97f4a7c15UL); }
+        
+    private:
+        container_type list_;
+        counters stats_;
+    };
+    
+    template <typename K, typename O, size_t N, class H, class P>
+    auto lru_cache<K,O,N,H,P>::
+    get(key_type const& key) -> mapped_type* {
+        auto found = list_.find(key);
+        if(found == list_.end()) {
+            ++stats_.misses;
+            return nullptr;
+        }
+        ++stats_.hits;
+        list_.move_to_back(found);
+        return &found->second;
+    }
+    
+    template <typename K, typename O, size_t N, class H, class P>
+    template <typename M>
+    auto lru_cache<K,O,N,H,P>::
+    put(key_type const& key, M&& obj) -> mapped_type& {
+        for(;;) {
+            auto result = list_.try_emplace_back(key, std::forward<M>(obj));
+            if(result.second)
+                return result.first->second;
+            if(result.first != list_.end()) {
+                result.first->second = std::forward<M>(obj); // wasn't moved from
+                list_.move_to_back(result.first);
+                return result.first->second;
+            }
+            
+            // No free slot for key: may take several evictions under displacing Probe
+            if(list_.empty())
+                throw std::bad_alloc{};
+            list_.erase(list_.begin());
+            ++stats_.evictions;
+        }
+    }
+    
+} // hl
+} // ax
+
+#undef LOG_HEAD
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <ax.hashlist.hpp>
+
+#define LOG_HEAD "[hl]: "
+
+namespace ax { namespace hl {
+    
+    namespace detail {
+        
+        /// Smallest number of slots worth a thread
+        enum : size_t { PARALLEL_CHUNK = 1 << 14 };
+        
+        /// @returns number of chunks of HL's slots for threads (0 means hardware concurrency)
+        template <class HL>
+        size_t chunks_for(size_t threads) {
+            if(threads == 0)
+                threads = std::max(1U, std::thread::hardware_concurrency());
+            return std::min(threads, (HL::max_size() + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK);
+        }
+        
+        /**
+         * Splits slots of HL into chunks, runs task(chunk, first, last)
+         * for every chunk on its own thread (the last one on calling thread),
+         * rethrows the first exception after all threads are joined.
+         */
+        template <class HL, typename Task>
+        void run_chunks(size_t chunks, Task&& task) {
+            const size_t slots = HL::max_size();
+            
+            std::vector<std::exception_ptr> errors(chunks);
+            auto run = [&](size_t chunk) {
+                try {
+                    task(chunk, slots * chunk / chunks, slots * (chunk + 1) / chunks);
+                } catch(...) {
+                    errors[chunk] = std::current_exception();
+                }
+            };
+            
+            std::vector<std::thread> workers;
+            workers.reserve(chunks - 1);
+            for(size_t chunk = 0; chunk + 1 < chunks; ++chunk)
+                workers.emplace_back(run, chunk);
+            run(chunks - 1);
+            for(auto& worker : workers)
+                worker.join();
+            
+            for(auto const& error : errors)
+                if(error)
+                    std::rethrow_exception(error);
+        }
+        
+    } // detail
+    
+    /**
+     * Calls f(value_type&) for all elements of list concurrently:
+     * slots are split into contiguous chunks scanned in storage order
+     * (see hashlist::for_each_in_slots) by separate threads.
+     * List mustn't be modified meanwhile, f is called for distinct
+     * elements concurrently.
+     * @arg threads - number of threads, 0 means hardware concurrency
+     *      (small tables are scanned by fewer threads)
+     */
+    template <class HL, typename F>
+    void parallel_for_each(HL& list, F&& f, size_t threads = 0) {
+        using list_t = typename std::remove_const<HL>::type;
+        detail::run_chunks<list_t>(detail::chunks_for<list_t>(threads),
+            [&](size_t, size_t first, size_t last) {
+                list.for_each_in_slots(first, last, f); });
+    }
+    
+    /**
+     * Parallel unordered reduction: every chunk of slots folds
+     * map(value_type const&) of its elements with reduce on its own thread,
+     * then init and chunk results are folded in chunk order.
+     * reduce must be associative, elements are visited in storage order.
+     * @returns reduce(...reduce(init, map(e1)), ..., map(en))
+     */
+    template <class HL, typename T, typename Map, typename Reduce>
+    T parallel_transform_reduce(HL const& list, T init, Map&& map, Reduce&& reduce, size_t threads = 0) {
+        struct partial_t {
+            bool used;
+            T value;
+        };
+        
+        size_t chunks = detail::chunks_for<HL>(threads);
+        std::vector<partial_t> partials(chunks, partial_t{false, init});
+        detail::run_chunks<HL>(chunks,
+            [&](size_t chunk, size_t first, size_t last) {
+                // Folded locally: neighbouring partials share cache lines, written once
+                partial_t partial{false, init};
+                list.for_each_in_slots(first, last, [&](typename HL::value_type const& v) {
+                    partial.value = partial.used ? reduce(std::move(partial.value), map(v)) : map(v);
+                    partial.used = true;
+                });
+                partials[chunk] = std::move(partial);
+            });
+        
+        for(size_t chunk = 0; chunk < chunks; ++chunk)
+            if(partials[chunk].used)
+                init = reduce(std::move(init), std::move(partials[chunk].value));
+        return init;
+    }
+    
+} // hl
+} // ax
+
+#undef LOG_HEAD
@@ -0,0 +1,418 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <ax.hashlist.hpp>
+#include <ax.hashlist_seqlock.hpp>
+
+#define LOG_HEAD "[hl]: "
+
+namespace ax { namespace hl {
+    
+    /// Mutations carried by change feed
+    enum class change_op : uint32_t {
+        emplace,    // emplace_back(key, value)
+        upsert,     // insert_or_assign(key, value)
+        erase,      // erase(element)
+        to_back,    // move_to_back(element)
+        to_front,   // move_to_front(element)
+        clear,
+        rehash,
+        compact
+    };
+    
+    /**
+     * Change record: element is addressed by its offset
+     * (see hashlist::offset_of_element()), key is kept for validation.
+     * Trivially copyable: readers copy records out optimistically.
+     */
+    template <class HL>
+    struct change_record {
+        using key_type      = typename HL::key_type;
+        using mapped_type   = typename HL::mapped_type;
+        
+        change_op op;
+        uint64_t offset;
+        typename std::aligned_storage<sizeof(key_type), alignof(key_type)>::type key_;
+        typename std::aligned_storage<sizeof(mapped_type), alignof(mapped_type)>::type value_;
+        
+        key_type const& key() const {
+            return *reinterpret_cast<key_type const*>(&key_); }
+        
+        mapped_type const& value() const {
+            return *reinterpret_cast<mapped_type const*>(&value_); }
+    };
+    
+    /**
+     * Hashlist with change feed for replicas (see hl::replica).
+     * Writer's mutations are published into fixed ring of Records
+     * change records, the table itself is seqlocked: replica falling
+     * behind by more than Records takes block copy of it instead.
+     * Single writer, any number of replicas, which never slow the writer
+     * down: ring is broadcast, lapped readers notice it by record stamps.
+     * Records address elements by offsets, so logged table may be placed
+     * into shared memory (see hl::shared) and feed replicas of other processes.
+     * Keys and values must be trivially copyable.
+     * @arg HL - hashlist type
+     * @arg Records - ring capacity, power of 2
+     */
+    template <class HL, size_t Records = 4096>
+    class logged {
+    public:
+        using container_type = HL;
+        using key_type       = typename HL::key_type;
+        using mapped_type    = typename HL::mapped_type;
+        using value_type     = typename HL::value_type;
+        using size_type      = typename HL::size_type;
+        using iterator       = typename HL::iterator;
+        using const_iterator = typename HL::const_iterator;
+        using record_type    = change_record<HL>;
+        
+        static_assert(Records > 0 && (Records & (Records - 1)) == 0, LOG_HEAD
+            "number of change records must be power of 2");
+        
+        /// Result of fetch()
+        enum class fetch_result { ready, pending, lost };
+        
+        logged() : head_(0) {
+            for(auto& slot : ring_)
+                slot.stamp.store(0, std::memory_order_relaxed);
+        }
+        
+        logged(logged const&) = delete;
+        logged& operator=(logged const&) = delete;
+        
+        // ###################### Writer ###################### //
+        
+        /// @throws std::bad_alloc if table is full, nothing is published then
+        template <typename... Args>
+        iterator emplace_back(key_type const& key, Args&&... args);
+        
+        std::pair<iterator, bool> insert_or_assign(key_type const& key, mapped_type const& obj);
+        
+        size_type erase(key_type const& key);
+        
+        iterator erase(const_iterator pos);
+        
+        void move_to_back(const_iterator pos);
+        
+        void move_to_front(const_iterator pos);
+        
+        void clear();
+        
+        void rehash();
+        
+        void compact();
+        
+        /// Unsynchronized access: for writer thread or quiescent state only
+        HL const& unsafe() const { return table_.unsafe(); }
+        
+        // ###################### Readers ###################### //
+        
+        /// Copies value found by key to out, @returns false if there is no key
+        bool find(key_type const& key, mapped_type& out) const {
+            return table_.find(key, out); }
+        
+        size_type size() const {
+            return table_.size(); }
+        
+        /// Copies the whole table to out (see seqlocked::copy()), @returns head() of the copy
+        uint64_t copy(HL& out) const {
+            return table_.copy(out, [this] { return head(); }); }
+        
+        /// @returns number of published records (sequence number of the next one)
+        uint64_t head() const {
+            return head_.load(std::memory_order_acquire); }
+        
+        static constexpr size_t capacity() { return Records; }
+        
+        /**
+         * Copies record seq to out. @returns ready, pending if it isn't
+         * published yet or lost if it's overwritten by newer records
+         */
+        fetch_result fetch(uint64_t seq, record_type& out) const;
+        
+        static uint64_t layout_fingerprint() {
+            return seqlocked<HL>::layout_fingerprint() ^ (sizeof(logged) * 0x9e3779b97f4a7c15UL); }
+        
+    private:
+        struct slot_t {
+            /// 2*seq + 1 while record seq is written, 2*seq + 2 once it's published
+            std::atomic<uint64_t> stamp;
+            record_type record;
+        };
+        
+        /// Appends record, called inside write section
+        void publish(change_op op, size_t offset = 0,
+            key_type const* key = nullptr, mapped_type const* value = nullptr);
+        
+        /// Publishes op of element at pos and runs f(HL&, pos) in one write section
+        template <typename F>
+        auto mutate(change_op op, const_iterator pos, F&& f) -> decltype(f(std::declval<HL&>(), pos));
+        
+        seqlocked<HL> table_;
+        
+        /// Head has its own cache line: replicas poll it
+        std::atomic<uint64_t> head_;
+        char padding_[64 - sizeof(std::atomic<uint64_t>)];
+        std::array<slot_t, Records> ring_;
+    };
+    
+    template <class HL, size_t R>
+    void logged<HL,R>::
+    publish(change_op op, size_t offset, key_type const* key, mapped_type const* value) {
+        uint64_t seq = head_.load(std::memory_order_relaxed);
+        auto& slot = ring_[seq & (R - 1)];
+        slot.stamp.store(2*seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        
+        // Readers may copy the slot meanwhile: record is stored by relaxed words
+        record_type record;
+        std::memset(&record, 0, sizeof(record));
+        record.op = op;
+        record.offset = offset;
+        if(key != nullptr)
+            std::memcpy(&record.key_, key, sizeof(key_type));
+        if(value != nullptr)
+            std::memcpy(&record.value_, value, sizeof(mapped_type));
+        detail::store_relaxed(&slot.record, &record);
+        
+        slot.stamp.store(2*seq + 2, std::memory_order_release);
+        head_.store(seq + 1, std::memory_order_release);
+    }
+    
+    template <class HL, size_t R>
+    auto logged<HL,R>::
+    fetch(uint64_t seq, record_type& out) const -> fetch_result {
+        auto const& slot = ring_[seq & (R - 1)];
+        uint64_t stamp = slot.stamp.load(std::memory_order_acquire);
+        if(stamp != 2*seq + 2)
+            return stamp < 2*seq + 2 ? fetch_result::pending : fetch_result::lost;
+        
+        detail::load_relaxed(&out, &slot.record);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.stamp.load(std::memory_order_relaxed) == stamp ? fetch_result::ready : fetch_result::lost;
+    }
+    
+    template <class HL, size_t R>
+    template <typename F>
+    auto logged<HL,R>::
+    mutate(change_op op, const_iterator pos, F&& f) -> decltype(f(std::declval<HL&>(), pos)) {
+        return table_.write([&](HL& l) -> decltype(f(l, pos)) {
+            publish(op, l.offset_of_element(pos), &pos->first, &pos->second);
+            return f(l, pos);
+        });
+    }
+    
+    template <class HL, size_t R>
+    template <typename... Args>
+    auto logged<HL,R>::
+    emplace_back(key_type const& key, Args&&... args) -> iterator {
+        return table_.write([&](HL& l) -> iterator {
+            auto it = l.emplace_back(key, std::forward<Args>(args)...);
+            publish(change_op::emplace, l.offset_of_element(it), &it->first, &it->second);
+            return it;
+        });
+    }
+    
+    template <class HL, size_t R>
+    auto logged<HL,R>::
+    insert_or_assign(key_type const& key, mapped_type const& obj) -> std::pair<iterator, bool> {
+        return table_.write([&](HL& l) -> std::pair<iterator, bool> {
+            auto result = l.insert_or_assign(key, obj);
+            if(result.first != l.end())
+                publish(change_op::upsert, l.offset_of_element(result.first), &key, &obj);
+            return result;
+        });
+    }
+    
+    template <class HL, size_t R>
+    auto logged<HL,R>::
+    erase(key_type const& key) -> size_type {
+        auto found = unsafe().find(key);
+        if(found == unsafe().end())
+            return 0;
+        erase(found);
+        return 1;
+    }
+    
+    template <class HL, size_t R>
+    auto logged<HL,R>::
+    erase(const_iterator pos) -> iterator {
+        return mutate(change_op::erase, pos, [](HL& l, const_iterator p) { return l.erase(p); });
+    }
+    
+    template <class HL, size_t R>
+    void logged<HL,R>::
+    move_to_back(const_iterator pos) {
+        mutate(change_op::to_back, pos, [](HL& l, const_iterator p) { l.move_to_back(p); });
+    }
+    
+    template <class HL, size_t R>
+    void logged<HL,R>::
+    move_to_front(const_iterator pos) {
+        mutate(change_op::to_front, pos, [](HL& l, const_iterator p) { l.move_to_front(p); });
+    }
+    
+    template <class HL, size_t R>
+    void logged<HL,R>::
+    clear() {
+        table_.write([this](HL& l) {
+            l.clear();
+            publish(change_op::clear);
+        });
+    }
+    
+    template <class HL, size_t R>
+    void logged<HL,R>::
+    rehash() {
+        table_.write([this](HL& l) {
+            l.rehash();
+            publish(change_op::rehash);
+        });
+    }
+    
+    template <class HL, size_t R>
+    void logged<HL,R>::
+    compact() {
+        table_.write([this](HL& l) {
+            l.compact();
+            publish(change_op::compact);
+        });
+    }
+    
+    /**
+     * Process-local replica of logged hashlist: poll() applies new change
+     * records to its own table in order (the same operations on the same
+     * table place elements into the same cells, as offsets of records
+     * confirm). Replica falls back to block copy of the whole table
+     * if the feed has overwritten unread records or a record doesn't match.
+     * @arg Feed - logged<HL, Records>, may be mapped from shared memory
+     */
+    template <class Feed>
+    class replica {
+    public:
+        using container_type = typename Feed::container_type;
+        using record_type    = typename Feed::record_type;
+        
+        /// Starts from block copy of feed's table
+        explicit replica(Feed const& feed) :
+            feed_(&feed), next_(0), resyncs_(0) {
+            resync(); }
+        
+        replica(replica const&) = delete;
+        replica& operator=(replica const&) = delete;
+        
+        /**
+         * Applies published records, at most max steps (resync is a step).
+         * @returns number of applied records
+         */
+        size_t poll(size_t max = SIZE_MAX);
+        
+        /// Replaces table by block copy of feed's one
+        void resync();
+        
+        container_type const& get()         const { return list_; }
+        container_type const& operator*()   const { return list_; }
+        container_type const* operator->()  const { return &list_; }
+        
+        /// @returns sequence number of the next record to apply
+        uint64_t position() const { return next_; }
+        
+        /// @returns number of published records not applied yet
+        uint64_t lag() const { return feed_->head() - next_; }
+        
+        /// @returns number of block copies taken after construction
+        uint64_t resyncs() const { return resyncs_; }
+        
+    private:
+        /// @returns false if record doesn't match table
+        bool apply(record_type const& record);
+        
+        /// @returns true if offset holds element with key (freed cells keep stale keys)
+        bool holds(uint64_t offset, typename container_type::key_type const& key) {
+            return list_.occupied(offset) && list_.element_by_offset(offset)->first == key; }
+        
+        Feed const* feed_;
+        container_type list_;
+        uint64_t next_;
+        uint64_t resyncs_;
+    };
+    
+    template <class Feed>
+    void replica<Feed>::
+    resync() {
+        next_ = feed_->copy(list_);
+    }
+    
+    template <class Feed>
+    size_t replica<Feed>::
+    poll(size_t max) {
+        size_t applied = 0;
+        record_type record;
+        for(size_t step = 0; step < max; ++step) {
+            auto result = feed_->fetch(next_, record);
+            if(result == Feed::fetch_result::pending)
+                break;
+            if(result == Feed::fetch_result::lost || !apply(record)) {
+                resync();
+                ++resyncs_;
+                continue;
+            }
+            ++next_;
+            ++applied;
+        }
+        return applied;
+    }
+    
+    template <class Feed>
+    bool replica<Feed>::
+    apply(record_type const& r) {
+        switch(r.op) {
+        case change_op::emplace:
+        case change_op::upsert:
+            try {
+                auto it = r.op == change_op::emplace
+                    ? list_.emplace_back(r.key(), r.value())
+                    : list_.insert_or_assign(r.key(), r.value()).first;
+                return it != list_.end() && list_.offset_of_element(it) == r.offset;
+            } catch(std::bad_alloc&) {
+                return false;
+            }
+        case change_op::erase:
+            if(!holds(r.offset, r.key()))
+                return false;
+            list_.erase(list_.element_by_offset(r.offset));
+            return true;
+        case change_op::to_back:
+        case change_op::to_front:
+            if(!holds(r.offset, r.key()))
+                return false;
+            if(r.op == change_op::to_back)
+                list_.move_to_back(list_.element_by_offset(r.offset));
+            else
+                list_.move_to_front(list_.element_by_offset(r.offset));
+            return true;
+        case change_op::clear:
+            list_.clear();
+            return true;
+        case change_op::rehash:
+            list_.rehash();
+            return true;
+        case change_op::compact:
+            list_.compact();
+            return true;
+        }
+        return false;
+    }
+    
+} // hl
+} // ax
+
+#undef LOG_HEAD
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <ax.hashlist.hpp>
+
+#define LOG_HEAD "[hl]: "
+
+namespace ax { namespace hl {
+    
+    /**
+     * Single writer / multiple readers mode of hashlist based on
+     * per-table sequence lock: writer never blocks, readers copy data out
+     * optimistically and retry if writer has touched table meanwhile.
+     * Works between processes too (see hl::shared), offsets stored in
+     * links always point inside storage, so torn reads are memory-safe
+     * and readers' walks are bounded by capacity.
+     * Readers don't race with the writer: hashlist keeps index words,
+     * links and counters in relaxed atomics (see detail::relaxed),
+     * stores trivial elements and compares keys of probes by relaxed
+     * words, readers copy elements out the same way.
+     * Keys and values must be trivially copyable, stats are disabled.
+     * @arg HL - hashlist type
+     */
+    template <class HL>
+    class seqlocked {
+    public:
+        using container_type = HL;
+        using key_type       = typename HL::key_type;
+        using mapped_type    = typename HL::mapped_type;
+        using value_type     = typename HL::value_type;
+        using size_type      = typename HL::size_type;
+        
+        static_assert(std::is_trivially_copyable<key_type>::value &&
+                      std::is_trivially_copyable<mapped_type>::value, LOG_HEAD
+            "seqlocked readers copy torn data: key and value must be trivially copyable");
+        static_assert(!HL::stats_type::enabled, LOG_HEAD
+            "seqlocked readers would race on stats counters");
+        
+        seqlocked() : seq_(0) {}
+        
+        seqlocked(seqlocked const&) = delete;
+        seqlocked& operator=(seqlocked const&) = delete;
+        
+        // ###################### Writer ###################### //
+        
+        /**
+         * Runs f(HL&) as one write section, @returns f's result.
+         * f must change table by its modifiers only (emplace_back(),
+         * insert_or_assign(), erase(), rehash()...): stores through
+         * references to values, whole table assignments and load()
+         * aren't atomic and race with readers.
+         */
+        template <typename F>
+        auto write(F&& f) -> decltype(f(std::declval<HL&>())) {
+            write_guard guard(*this);
+            return f(list_);
+        }
+        
+        template <typename... Args>
+        typename HL::iterator emplace_back(key_type const& key, Args&&... args) {
+            write_guard guard(*this);
+            return list_.emplace_back(key, std::forward<Args>(args)...);
+        }
+        
+        typename HL::iterator erase(typename HL::const_iterator pos) {
+            write_guard guard(*this);
+            return list_.erase(pos);
+        }
+        
+        void clear() {
+            write_guard guard(*this);
+            list_.clear();
+        }
+        
+        void rehash() {
+            write_guard guard(*this);
+            list_.rehash();
+        }
+        
+        /// Unsynchronized access: for writer thread or quiescent state only
+        HL& unsafe() { return list_; }
+        
+        HL const& unsafe() const { return list_; }
+        
+        // ###################### Readers ###################### //
+        
+        /// Copies value found by key to out, @returns false if there is no key
+        bool find(key_type const& key, mapped_type& out) const;
+        
+        /// Single relaxed load: consistent by itself
+        size_type size() const {
+            return list_.size(); }
+        
+        /**
+         * Copies all elements in adding order to out (cleared before),
+         * Container must provide clear() and emplace_back(key, value).
+         */
+        template <typename Container>
+        void snapshot(Container& out) const;
+        
+        /// Copies the whole table to out as a block (see hashlist::copy_relaxed())
+        void copy(HL& out) const {
+            copy(out, [] { return 0; }); }
+        
+        /**
+         * Same, f() (e.g. loads of writer's own atomics) runs inside
+         * the same read section, @returns its result consistent with the copy
+         */
+        template <typename F>
+        auto copy(HL& out, F&& f) const -> decltype(f());
+        
+        /// @returns even number of finished write sections (x2)
+        uint64_t version() const {
+            return seq_.load(std::memory_order_acquire); }
+        
+        static uint64_t layout_fingerprint() {
+            return HL::layout_fingerprint() ^ (sizeof(seqlocked) * 0x9e3779b97f4a7c15UL); }
+        
+    private:
+        /// Odd sequence means write in progress
+        class write_guard {
+        public:
+            explicit write_guard(seqlocked& lock) : lock_(lock) {
+                auto seq = lock_.seq_.load(std::memory_order_relaxed);
+                lock_.seq_.store(seq + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+            
+            ~write_guard() {
+                auto seq = lock_.seq_.load(std::memory_order_relaxed);
+                lock_.seq_.store(seq + 1, std::memory_order_release);
+            }
+            
+        private:
+            seqlocked& lock_;
+        };
+        
+        /// Waits for even sequence, @returns it
+        uint64_t read_begin() const;
+        
+        /// @returns true if nothing was written since read_begin()
+        bool read_validate(uint64_t seq) const {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return seq_.load(std::memory_order_relaxed) == seq;
+        }
+        
+        /// Sequence has its own cache line: readers spin on it
+        std::atomic<uint64_t> seq_;
+        char padding_[64 - sizeof(std::atomic<uint64_t>)];
+        
+        HL list_;
+    };
+    
+    template <class HL>
+    uint64_t seqlocked<HL>::
+    read_begin() const {
+        for(;;) {
+            auto seq = seq_.load(std::memory_order_acquire);
+            if((seq & 1) == 0)
+                return seq;
+        #if defined(__SSE2__)
+            _mm_pause();
+        #endif
+        }
+    }
+    
+    template <class HL>
+    template <typename F>
+    auto seqlocked<HL>::
+    copy(HL& out, F&& f) const -> decltype(f()) {
+        for(;;) {
+            auto seq = read_begin();
+            out.copy_relaxed(list_);
+            auto result = f();
+            if(read_validate(seq))
+                return result;
+        }
+    }
+    
+    /// Torn value may be copied to out before retry: out is scratch until return
+    template <class HL>
+    bool seqlocked<HL>::
+    find(key_type const& key, mapped_type& out) const {
+        for(;;) {
+            auto seq = read_begin();
+            auto found = list_.find(key);
+            bool exists = found != list_.end();
+            if(exists)
+                detail::load_relaxed(&out, &found->second);
+            if(read_validate(seq))
+                return exists;
+        }
+    }
+    
+    template <class HL>
+    template <typename Container>
+    void seqlocked<HL>::
+    snapshot(Container& out) const {
+        typename std::aligned_storage<sizeof(key_type), alignof(key_type)>::type key;
+        typename std::aligned_storage<sizeof(mapped_type), alignof(mapped_type)>::type value;
+        for(;;) {
+            out.clear();
+            auto seq = read_begin();
+            
+            // Links of cell being linked may be not written yet: check raw offsets before stepping
+            size_t steps = 0;
+            for(size_t idx = list_.linked_after(0); idx != 0; idx = list_.linked_after(idx)) {
+                if(idx > list_.max_size() || ++steps > list_.max_size())
+                    break;
+                auto it = list_.element_by_offset(idx);
+                detail::load_relaxed(reinterpret_cast<key_type*>(&key), &it->first);
+                detail::load_relaxed(reinterpret_cast<mapped_type*>(&value), &it->second);
+                out.emplace_back(*reinterpret_cast<key_type const*>(&key),
+                                 *reinterpret_cast<mapped_type const*>(&value));
+            }
+            
+            if(read_validate(seq))
+                return;
+        }
+    }
+    
+} // hl
+} // ax
+
+#undef LOG_HEAD
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <ax.hashlist.hpp>
+
+#define LOG_HEAD "[hl]: "
+
+namespace ax { namespace hl {
+    
+    /// Test-and-test-and-set lock, standard layout (may live in shared memory)
+    class spinlock {
+    public:
+        spinlock() : locked_(false) {}
+        
+        spinlock(spinlock const&) = delete;
+        spinlock& operator=(spinlock const&) = delete;
+        
+        void lock() {
+            for(;;) {
+                if(!locked_.exchange(true, std::memory_order_acquire))
+                    return;
+                while(locked_.load(std::memory_order_relaxed)) {
+                #if defined(__SSE2__)
+                    _mm_pause();
+                #endif
+                }
+            }
+        }
+        
+        bool try_lock() {
+            return !locked_.load(std::memory_order_relaxed) &&
+                !locked_.exchange(true, std::memory_order_acquire); }
+        
+        void unlock() {
+            locked_.store(false, std::memory_order_release); }
+        
+    private:
+        std::atomic<bool> locked_;
+    };
+    
+    /**
+     * Concurrent hashlist: Shards independent hashlists guarded by
+     * their own spinlocks, key is routed to shard by high bits of
+     * (Fibonacci mixed) h1, low bits are used inside shard.
+     * Adding order is kept per shard. If Stamped, every element gets
+     * global sequence stamp, so merged iteration is ordered too
+     * (costs one shared atomic increment per insertion).
+     * Access is provided by copying or by callbacks under shard's lock:
+     * f(key_type const&, mapped_type&).
+     * @arg N - capacity of each shard
+     * @arg Shards - number of shards, power of 2
+     */
+    template <
+        typename keyT,
+        typename objT,
+        size_t N,
+        size_t Shards,
+        class Hash = default_hash<keyT>,
+        bool Stamped = false
+    > class sharded_hashlist {
+        static_assert(Shards > 0 && (Shards & (Shards - 1)) == 0, LOG_HEAD
+            "number of shards must be power of 2");
+        
+        /// Mapped value with global stamp
+        struct stamped_t {
+            uint64_t stamp;
+            objT value;
+            
+            template <typename... Args>
+            stamped_t(uint64_t s, Args&&... args) :
+                stamp(s), value(std::forward<Args>(args)...) {}
+        };
+        
+        using stored_type = typename std::conditional<Stamped, stamped_t, objT>::type;
+        
+    public:
+        using key_type      = keyT;
+        using mapped_type   = objT;
+        using size_type     = size_t;
+        using hasher        = Hash;
+        using shard_type    = hashlist<keyT, stored_type, N, Hash>;
+        
+        sharded_hashlist() : clock_(0) {}
+        
+        sharded_hashlist(sharded_hashlist const&) = delete;
+        sharded_hashlist& operator=(sharded_hashlist const&) = delete;
+        
+        static constexpr size_type shards() { return Shards; }
+        
+        static constexpr size_type max_size() { return N*Shards; }
+        
+        /// @returns shard index of key
+        static size_t shard_of(key_type const& key) {
+            return Shards == 1 ? 0 :
+                size_t((hasher::h1(key) * 0x9e3779b97f4a7c15UL) >> (64 - log2(Shards))); }
+        
+        /// Sum of shards' sizes, not a snapshot while writers are active
+        size_type size() const;
+        
+        void clear();
+        
+        /**
+         * Constructs element at the back of key's shard.
+         * @throws std::bad_alloc if shard is full
+         */
+        template <typename... Args>
+        void emplace_back(key_type const& key, Args&&... args);
+        
+        /// Copies value found by key to out, @returns false if there is no key
+        bool find(key_type const& key, mapped_type& out) const;
+        
+        /// Calls f(key, value) for found element under lock, @returns true if found
+        template <typename F>
+        bool visit(key_type const& key, F&& f);
+        
+        /// Erases first element with key, @returns number of erased elements
+        size_type erase(key_type const& key);
+        
+        /// Calls f(key, value) for elements of shard in adding order
+        template <typename F>
+        void for_each_in_shard(size_t shard, F&& f);
+        
+        /// Calls f(key, value) shard by shard (ordered inside shard only)
+        template <typename F>
+        void for_each(F&& f);
+        
+        /**
+         * Calls f(key, value) for all elements in global adding order,
+         * locks all shards for the whole walk. Requires Stamped.
+         */
+        template <typename F>
+        void for_each_ordered(F&& f);
+        
+    private:
+        static constexpr size_t log2(size_t x) {
+            return x <= 1 ? 0 : 1 + log2(x >> 1); }
+        
+        static mapped_type& value_of(objT& v) { return v; }
+        static mapped_type& value_of(stamped_t& v) { return v.value; }
+        static mapped_type const& value_of(objT const& v) { return v; }
+        static mapped_type const& value_of(stamped_t const& v) { return v.value; }
+        
+        template <typename... Args>
+        typename shard_type::iterator emplace_stored(shard_type& list, std::true_type,
+            key_type const& key, Args&&... args) {
+            return list.emplace_back(key, stamped_t(
+                clock_.fetch_add(1, std::memory_order_relaxed), std::forward<Args>(args)...)); }
+        
+        template <typename... Args>
+        typename shard_type::iterator emplace_stored(shard_type& list, std::false_type,
+            key_type const& key, Args&&... args) {
+            return list.emplace_back(key, std::forward<Args>(args)...); }
+        
+        /// Lock has its own cache line
+        struct shard_t {
+            char padding_front_[64];
+            mutable spinlock lock;
+            char padding_back_[64 - sizeof(spinlock)];
+            shard_type list;
+        };
+        
+        std::atomic<uint64_t> clock_;
+        char padding_[64 - sizeof(std::atomic<uint64_t>)];
+        std::array<shard_t, Shards> shards_;
+    };
+    
+    template <typename K, typename O, size_t N, size_t S, class H, bool T>
+    auto sharded_hashlist<K,O,N,S,H,T>::
+    size() const -> size_type {
+        size_type total = 0;
+        for(auto const& shard : shards_) {
+            std::lock_guard<spinlock> guard(shard.lock);
+            total += shard.list.size();
+        }
+        return total;
+    }
+    
+    template <typename K, typename O, size_t N, size_t S, class H, bool T>
+    void sharded_hashlist<K,O,N,S,H,T>::
+    clear() {
+        for(auto& shard : shards_) {
+            std::lock_guard<spinlock> guard(shard.lock);
+            shard.list.clear();
+        }
+    }
+    
+    template <typename K, typename O, size_t N, size_t S, class H, bool T>
+    template <typename... Args>
+    void sharded_hashlist<K,O,N,S,H,T>::
+    emplace_back(key_type const& key, Args&&... args) {
+        auto& shard = shards_[shard_of(key)];
+        std::lock_guard<spinlock> guard(shard.lock);
+        emplace_stored(shard.list, std::integral_constant<bool, T>(), key, std::forward<Args>(args)...);
+    }
+    
+    template <typename K, typename O, size_t N, size_t S, class H, bool T>
+    bool sharded_hashlist<K,O,N,S,H,T>::
+    find(key_type const& key, mapped_type& out) const {
+        auto const& shard = shards_[shard_of(key)];
+        std::lock_guard<spinlock> guard(shard.lock);
+        auto found = shard.list.find(key);
+        if(found == shard.list.end())
+            return false;
+        out = value_of(found->second);
+        return true;
+    }
+    
+    template <typename K, typename O, size_t N, size_t S, class H, bool T>
+    template <typename F>
+    bool sharded_hashlist<K,O,N,S,H,T>::
+    visit(key_type const& key, F&& f) {
+        auto& shard = shards_[shard_of(key)];
+        std::lock_guard<spinlock> guard(shard.lock);
+        auto found = shard.list.find(key);
+        if(found == shard.list.end())
+            return false;
+        f(found->first, value_of(found->second));
+        return true;
+    }
+    
+    template <typename K, typename O, size_t N, size_t S, class H, bool T>
+    auto sharded_hashlist<K,O,N,S,H,T>::
+    erase(key_type const& key) -> size_type {
+        auto& shard = shards_[shard_of(key)];
+        std::lock_guard<spinlock> guard(shard.lock);
+        auto found = shard.list.find(key);
+        if(found == shard.list.end())
+            return 0;
+        shard.list.erase(found);
+        return 1;
+    }
+    
+    template <typename K, typename O, size_t N, size_t S, class H, bool T>
+    template <typename F>
+    void sharded_hashlist<K,O,N,S,H,T>::
+    for_each_in_shard(size_t idx, F&& f) {
+        auto& shard = shards_[idx];
+        std::lock_guard<spinlock> guard(shard.lock);
+        for(auto& p : shard.list)
+            f(p.first, value_of(p.second));
+    }
+    
+    template <typename K, typename O, size_t N, size_t S, class H, bool T>
+    template <typename F>
+    void sharded_hashlist<K,O,N,S,H,T>::
+    for_each(F&& f) {
+        for(size_t idx = 0; idx < S; ++idx)
+            for_each_in_shard(idx, f);
+    }
+    
+    template <typename K, typename O, size_t N, size_t S, class H, bool T>
+    template <typename F>
+    void sharded_hashlist<K,O,N,S,H,T>::
+    for_each_ordered(F&& f) {
+        static_assert(T, LOG_HEAD "ordered iteration requires Stamped sharded_hashlist");
+        
+        // Shards are always locked in the same order
+        struct lock_all {
+            std::array<shard_t, S>& shards;
+            
+            explicit lock_all(std::array<shard_t, S>& s) : shards(s) {
+                for(auto& shard : shards)
+                    shard.lock.lock();
+            }
+            
+            ~lock_all() {
+                for(auto& shard : shards)
+                    shard.lock.unlock();
+            }
+        } guard(shards_);
+        
+        std::array<typename shard_type::iterator, S> cursors;
+        for(size_t idx = 0; idx < S; ++idx)
+            cursors[idx] = shards_[idx].list.begin();
+        
+        // K-way merge: every shard is already ordered by stamps
+        for(;;) {
+            size_t next = S;
+            for(size_t idx = 0; idx < S; ++idx) {
+                if(cursors[idx] == shards_[idx].list.end())
+                    continue;
+                if(next == S || cursors[idx]->second.stamp < cursors[next]->second.stamp)
+                    next = idx;
+            }
+            if(next == S)
+                break;
+            auto& p = *cursors[next]++;
+            f(p.first, value_of(p.second));
+        }
+    }
+    
+} // hl
+} // ax
+
+#undef LOG_HEAD
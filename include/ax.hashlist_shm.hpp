@@ -0,0 +1,270 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ax.hashlist.hpp>
+
+#define LOG_HEAD "[hl]: "
+
+namespace ax { namespace hl {
+    
+    /**
+     * Header of shared segment, placed at its beginning,
+     * container follows at header.offset.
+     */
+    struct shm_header {
+        enum : uint64_t { MAGIC = 0x7473696c68736168UL }; // "hashlist"
+        enum : uint32_t { VERSION = 1 };
+        
+        /// Container is being constructed or destroyed
+        enum : uint32_t { NOT_READY = 0, READY = 1 };
+        
+        uint64_t magic;
+        uint32_t version;
+        std::atomic<uint32_t> state;
+        uint64_t fingerprint;
+        uint64_t offset;
+        uint64_t size;
+    };
+    
+    /// Options of shared mapping
+    struct shm_options {
+        enum backing_t {
+            posix_shm,  // shm_open(name), name like "/my.table"
+            file        // open(name), e.g. file on hugetlbfs mount or /dev/shm
+        };
+        
+        backing_t backing;
+        
+        /// Round mapping to 2 MiB and ask for huge pages: file on hugetlbfs
+        /// is backed by huge pages anyway, shmem gets MADV_HUGEPAGE (THP)
+        bool huge_pages;
+        
+        /// Prefault pages on mapping (MAP_POPULATE)
+        bool populate;
+        
+        shm_options(backing_t b = posix_shm, bool huge = false, bool prefault = false) :
+            backing(b), huge_pages(huge), populate(prefault) {}
+    };
+    
+    /**
+     * Owner of process-local mapping of hashlist placed into
+     * POSIX shared memory or file. Container is found by offsets only,
+     * so mappings may have different addresses in different processes.
+     * Synchronization between processes is up to user.
+     * @arg HL - hashlist type, same in all processes (checked on attach)
+     */
+    template <class HL>
+    class shared {
+    public:
+        using container_type = HL;
+        
+        /// Creates (truncates) segment, constructs container in place
+        static shared create(std::string const& name, shm_options opts = shm_options());
+        
+        /// Maps existing segment without running c-tor, validates layout
+        static shared attach(std::string const& name, shm_options opts = shm_options());
+        
+        /// Removes segment name, existing mappings stay valid
+        static void remove(std::string const& name, shm_options opts = shm_options());
+        
+        shared(shared&& other) noexcept;
+        
+        shared(shared const&) = delete;
+        shared& operator=(shared const&) = delete;
+        
+        /// Unmaps segment, container isn't destroyed (see destroy())
+        ~shared();
+        
+        /// Runs container's d-tor, other processes can't attach anymore
+        void destroy();
+        
+        HL* get()               const { return list_; }
+        HL& operator*()         const { return *list_; }
+        HL* operator->()        const { return list_; }
+        
+        shm_header const& header() const {
+            return *static_cast<shm_header const*>(addr_); }
+        
+        /// @returns bytes required for segment
+        static size_t segment_size(shm_options const& opts);
+        
+    private:
+        void* addr_;
+        size_t length_;
+        HL* list_;
+        
+        shared(void* addr, size_t length, HL* list) :
+            addr_(addr), length_(length), list_(list) {}
+        
+        static size_t container_offset();
+        
+        static int open_fd(std::string const& name, shm_options const& opts, int flags);
+        
+        static void* map(int fd, size_t length, shm_options const& opts);
+        
+        [[noreturn]] static void fail(char const* what);
+    };
+    
+    template <class HL>
+    size_t shared<HL>::
+    container_offset() {
+        size_t align = alignof(HL) > 64 ? alignof(HL) : 64;
+        return (sizeof(shm_header) + align - 1) / align * align;
+    }
+    
+    template <class HL>
+    size_t shared<HL>::
+    segment_size(shm_options const& opts) {
+        size_t length = container_offset() + sizeof(HL);
+        size_t page = opts.huge_pages ? (2UL << 20) : size_t(sysconf(_SC_PAGESIZE));
+        return (length + page - 1) / page * page;
+    }
+    
+    template <class HL>
+    void shared<HL>::
+    fail(char const* what) {
+        throw std::system_error(errno, std::system_category(), std::string(LOG_HEAD) + what); }
+    
+    template <class HL>
+    int shared<HL>::
+    open_fd(std::string const& name, shm_options const& opts, int flags) {
+        int fd = opts.backing == shm_options::posix_shm
+            ? shm_open(name.c_str(), flags, 0666)
+            : open(name.c_str(), flags, 0666);
+        if(fd < 0)
+            fail("can't open shared segment");
+        return fd;
+    }
+    
+    template <class HL>
+    void* shared<HL>::
+    map(int fd, size_t length, shm_options const& opts) {
+        int flags = MAP_SHARED;
+    #if defined(MAP_POPULATE)
+        if(opts.populate)
+            flags |= MAP_POPULATE;
+    #endif
+        void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, fd, 0);
+        if(addr == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            fail("can't map shared segment");
+        }
+        close(fd);
+    
+    #if defined(MADV_HUGEPAGE)
+        if(opts.huge_pages)
+            madvise(addr, length, MADV_HUGEPAGE); // advice only, may be unsupported
+    #endif
+        return addr;
+    }
+    
+    template <class HL>
+    auto shared<HL>::
+    create(std::string const& name, shm_options opts) -> shared {
+        size_t length = segment_size(opts);
+        int fd = open_fd(name, opts, O_CREAT | O_RDWR | O_TRUNC);
+        if(ftruncate(fd, off_t(length)) != 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            fail("can't resize shared segment");
+        }
+        
+        void* addr = map(fd, length, opts);
+        auto header = new(addr) shm_header;
+        header->state.store(shm_header::NOT_READY, std::memory_order_relaxed);
+        header->magic       = shm_header::MAGIC;
+        header->version     = shm_header::VERSION;
+        header->fingerprint = HL::layout_fingerprint();
+        header->offset      = container_offset();
+        header->size        = sizeof(HL);
+        
+        auto list = new(static_cast<char*>(addr) + container_offset()) HL;
+        header->state.store(shm_header::READY, std::memory_order_release);
+        return shared(addr, length, list);
+    }
+    
+    template <class HL>
+    auto shared<HL>::
+    attach(std::string const& name, shm_options opts) -> shared {
+        int fd = open_fd(name, opts, O_RDWR);
+        struct stat st;
+        if(fstat(fd, &st) != 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            fail("can't stat shared segment");
+        }
+        
+        size_t length = size_t(st.st_size);
+        if(length < container_offset() + sizeof(HL)) {
+            close(fd);
+            throw std::runtime_error(LOG_HEAD "shared segment is too small");
+        }
+        
+        void* addr = map(fd, length, opts);
+        shared mapping(addr, length, nullptr);
+        
+        auto const& header = mapping.header();
+        if(header.magic != shm_header::MAGIC || header.version != shm_header::VERSION)
+            throw std::runtime_error(LOG_HEAD "shared segment isn't a hashlist");
+        if(header.fingerprint != HL::layout_fingerprint() ||
+           header.offset != container_offset() || header.size != sizeof(HL))
+            throw std::runtime_error(LOG_HEAD "hashlist layout mismatch");
+        if(header.state.load(std::memory_order_acquire) != shm_header::READY)
+            throw std::runtime_error(LOG_HEAD "hashlist isn't constructed");
+        
+        mapping.list_ = reinterpret_cast<HL*>(static_cast<char*>(addr) + header.offset);
+        return mapping;
+    }
+    
+    template <class HL>
+    void shared<HL>::
+    remove(std::string const& name, shm_options opts) {
+        int result = opts.backing == shm_options::posix_shm
+            ? shm_unlink(name.c_str())
+            : unlink(name.c_str());
+        if(result != 0)
+            fail("can't remove shared segment");
+    }
+    
+    template <class HL>
+    shared<HL>::
+    shared(shared&& other) noexcept :
+        addr_(other.addr_), length_(other.length_), list_(other.list_) {
+        other.addr_ = nullptr;
+        other.list_ = nullptr;
+    }
+    
+    template <class HL>
+    shared<HL>::
+    ~shared() {
+        if(addr_ != nullptr)
+            munmap(addr_, length_);
+    }
+    
+    template <class HL>
+    void shared<HL>::
+    destroy() {
+        auto header = static_cast<shm_header*>(addr_);
+        header->state.store(shm_header::NOT_READY, std::memory_order_release);
+        list_->~HL();
+    }
+    
+} // hl
+} // ax
+
+#undef LOG_HEAD
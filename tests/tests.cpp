@@ -2,13 +2,30 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <list>
 #include <map>
 #include <memory>
-#include <fstream>
+#include <sstream>
+#include <string>
+#include <iterator>
+#include <thread>
+#include <vector>
 
 #include <ax.hashlist.hpp>
+#include <ax.hashlist_dynamic.hpp>
+#include <ax.hashlist_lru.hpp>
+#include <ax.hashlist_parallel.hpp>
+#include <ax.hashlist_replica.hpp>
+#include <ax.hashlist_shm.hpp>
+#include <ax.hashlist_seqlock.hpp>
+#include <ax.hashlist_sharded.hpp>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace ax;
 
@@ -123,6 +140,56 @@ void haslist_test() {
         }
     }
     
+    {
+        // Tombstones: misses stop on never used slots, rehash drops erased ones
+        using hlt_t = hl::hashlist<int, int, N>;
+        hlt_t tl;
+        
+        const int half = N/2;
+        for(int i = 0; i < half; ++i)
+            tl.emplace_back(i, i);
+        for(int i = 0; i < half; i += 2)
+            tl.erase(tl.find(i));
+        
+        LIGHT_TEST(tl.size() == N/4);
+        LIGHT_TEST(tl.tombstones() == N/4);
+        for(int i = -half; i < 2*half; ++i)
+            LIGHT_TEST((tl.find(i) != tl.end()) == (i >= 0 && i < half && i % 2 == 1));
+        
+        std::vector<hlt_t::value_type> before(tl.begin(), tl.end());
+        tl.rehash();
+        LIGHT_TEST(tl.tombstones() == 0);
+        LIGHT_TEST(tl.size() == before.size());
+        LIGHT_TEST(std::equal(before.begin(), before.end(), tl.begin()));
+        for(auto const& p : before)
+            LIGHT_TEST(tl.find(p.first)->second == p.second);
+        
+        // Long churn: insertions never move cells, explicit rehash() keeps tombstones bounded
+        int next = half;
+        size_t rehashes = 0;
+        for(size_t i = 0; i < 64*N; ++i) {
+            auto last = tl.offset_of_element(--tl.end());
+            tl.erase(tl.begin());
+            tl.emplace_back(next, next);
+            ++next;
+            LIGHT_TEST(tl.offset_of_element(tl.find(next - 2)) == last);
+            if(tl.wants_rehash()) {
+                tl.rehash();
+                ++rehashes;
+            }
+            LIGHT_TEST(tl.tombstones() <= N/16 || tl.tombstones() <= (N - tl.size())/2 + 1);
+        }
+        LIGHT_TEST(rehashes > 0 && tl.size() == N/4);
+        int expected = next - N/4;
+        for(auto const& p : tl)
+            LIGHT_TEST(p.first == expected++);
+        for(int i = next - N/4; i < next; ++i)
+            LIGHT_TEST(tl.find(i)->second == i);
+        
+        tl.clear();
+        LIGHT_TEST(tl.tombstones() == 0);
+    }
+    
     {
         // Special stored type
         using hlp_t = hl::hashlist<int, std::unique_ptr<int>, N>;
@@ -180,108 +247,1925 @@ void haslist_test() {
                 size_t j = 0;
                 for(auto it = range.first; it != range.second; ++it, ++j)
                     LIGHT_TEST(it->second == i*div + j);
+                
+                // Same by probe sequence, any insertion order
+                LIGHT_TEST(ml.count(i) == div);
+                std::vector<hlm_t::const_iterator> found;
+                static_cast<hlm_t const&>(ml).find_all(i, std::back_inserter(found));
+                LIGHT_TEST(found.size() == div);
+                size_t sum = 0;
+                for(auto it : found)
+                    sum += it->second - i*div;
+                LIGHT_TEST(sum == div*(div - 1)/2);
             }
         }
     }
 }
 
-void perf() {
-    struct dummy_t {
-        std::array<char, 32> data;
-        dummy_t(char c) :
-            data{42} {
-            volatile char cv = c;
-            data[0] = cv;
-            data[data.size()-1] = cv;
-        };
-    };
+/// Duplicate keys under churn against std::multimap
+template <typename hl_t>
+void multimap_test(hl_t& l, size_t max_size) {
+    std::multimap<int, int> m;
+    const int domain = int(max_size / 8) + 1;
+    for(int i = 0; i < 16*int(max_size); ++i) {
+        int key = std::rand() % domain;
+        if(std::rand() % 3 == 0 && l.count(key) != 0) {
+            // Erase the oldest of key's values
+            std::vector<typename hl_t::iterator> found;
+            l.find_all(key, std::back_inserter(found));
+            auto oldest = *std::min_element(found.begin(), found.end(),
+                [](typename hl_t::iterator a, typename hl_t::iterator b) { return a->second < b->second; });
+            auto range = m.equal_range(key);
+            m.erase(std::find_if(range.first, range.second,
+                [&](std::pair<const int, int> const& p) { return p.second == oldest->second; }));
+            l.erase(oldest);
+        } else if(l.size() < max_size * 3 / 4) {
+            l.emplace_back(key, i);
+            m.emplace(key, i);
+        }
+    }
+    LIGHT_TEST(l.size() == m.size());
+    
+    for(int key = 0; key < domain; ++key) {
+        LIGHT_TEST(l.count(key) == m.count(key));
+        std::vector<int> expected, visited;
+        for(auto range = m.equal_range(key); range.first != range.second; ++range.first)
+            expected.push_back(range.first->second);
+        size_t n = l.for_each_equal(key, [&](typename hl_t::value_type& p) {
+            visited.push_back(p.second); });
+        LIGHT_TEST(n == expected.size());
+        std::sort(visited.begin(), visited.end());
+        LIGHT_TEST(visited == expected);
+    }
+    LIGHT_TEST(l.count(domain) == 0 && l.count(-1) == 0);
+}
+
+void multimap_policies_test() {
+    {
+        hl::hashlist<int, int, 1024> l;
+        multimap_test(l, l.max_size());
+    }
+    {
+        hl::hashlist<int, int, 100, hl::FNV_1<int>, hl::group_probing> l;
+        multimap_test(l, l.max_size());
+    }
+    {
+        hl::hashlist<int, int, 1024, hl::Fibonacci_hash<int>, hl::group_probing> l;
+        multimap_test(l, l.max_size());
+    }
+    {
+        hl::hashlist<int, int, 600, hl::FNV_1<int>, hl::robin_hood> l;
+        multimap_test(l, l.max_size());
+    }
+    {
+        hl::hashlist<int, int, 600, hl::FNV_1<int>, hl::robin_hood, hl::no_stats, hl::split<>> l;
+        multimap_test(l, l.max_size());
+    }
+    {
+        hl::hashlist<int, int, 1024, hl::Multiply_mix_hash<int>, hl::double_hashing, hl::probe_stats> l;
+        multimap_test(l, l.max_size());
+        l.reset_stats();
+        l.count(1);
+        LIGHT_TEST(l.stats().find_hits.walks + l.stats().find_misses.walks == 1);
+    }
+    {
+        hl::dynamic_hashlist<int, int> l;
+        multimap_test(l, 4096);
+    }
+}
+
+/// Random churn against std::list with periodic rehash
+template <typename hl_t>
+void probe_test() {
+    hl_t rl;
+    std::list<typename hl_t::value_type> sl;
+    const int domain = 4*rl.max_size();
+    
+    for(size_t i = 0; i < 16_KIB; ++i) {
+        int key = std::rand() % domain;
+        auto found = rl.find(key);
+        auto sfound = std::find_if(sl.begin(), sl.end(),
+            [&key](typename hl_t::value_type const& p) {
+                return p.first == key;
+            });
+        LIGHT_TEST((found == rl.end()) == (sfound == sl.end()));
+        
+        if(found != rl.end()) {
+            LIGHT_TEST(*found == *sfound);
+            rl.erase(found);
+            sl.erase(sfound);
+        } else if(rl.size() < rl.max_size()) {
+            rl.emplace_back(key, int(i));
+            sl.emplace_back(key, int(i));
+        }
+        
+        if(i % 64 == 0)
+            rl.rehash();
+        
+        // Bulk erasure of random range and of front
+        if(i % 512 == 256 && !sl.empty()) {
+            size_t from = std::rand() % sl.size();
+            size_t count = std::rand() % (sl.size() - from + 1);
+            auto rfirst = std::next(rl.begin(), from), rlast = std::next(rfirst, count);
+            auto sfirst = std::next(sl.begin(), from), slast = std::next(sfirst, count);
+            bool at_end = rlast == rl.end();
+            int next_key = at_end ? 0 : rlast->first;
+            
+            auto next = rl.erase(rfirst, rlast);
+            sl.erase(sfirst, slast);
+            LIGHT_TEST(at_end ? next == rl.end() : next->first == next_key);
+            
+            size_t popped = std::rand() % 4;
+            rl.pop_front(popped);
+            for(; popped > 0 && !sl.empty(); --popped)
+                sl.pop_front();
+        }
+        
+        LIGHT_TEST(rl.size() == sl.size());
+        if(i % 16 == 0) {
+            LIGHT_TEST(std::equal(sl.begin(), sl.end(), rl.begin()));
+            LIGHT_TEST(std::equal(sl.rbegin(), sl.rend(), rl.rbegin()));
+            for(auto const& p : sl)
+                LIGHT_TEST(rl.find(p.first)->second == p.second);
+            
+            std::vector<int> keys;
+            for(int k = 0; k < 37; ++k)
+                keys.push_back(std::rand() % domain);
+            std::vector<typename hl_t::iterator> found;
+            rl.find_batch(keys.begin(), keys.end(), std::back_inserter(found));
+            LIGHT_TEST(found.size() == keys.size());
+            for(size_t k = 0; k < keys.size(); ++k)
+                LIGHT_TEST(found[k] == rl.find(keys[k]));
+        }
+    }
+}
+
+void probe_policies_test() {
+    using incremental = hl::Incremental_integer_fasthash<int>;
+    
+    probe_test<hl::hashlist<int, int, 64>>();
+    probe_test<hl::hashlist<int, int, 64, incremental>>();
+    probe_test<hl::hashlist<int, int, 1024>>();
+    
+    probe_test<hl::hashlist<int, int, 8,    hl::FNV_1<int>, hl::group_probing>>();
+    probe_test<hl::hashlist<int, int, 64,   hl::FNV_1<int>, hl::group_probing>>();
+    probe_test<hl::hashlist<int, int, 64,   incremental,    hl::group_probing>>();
+    probe_test<hl::hashlist<int, int, 1024, hl::FNV_1<int>, hl::group_probing>>();
+    
+    // Arbitrary capacities
+    probe_test<hl::hashlist<int, int, 1>>();
+    probe_test<hl::hashlist<int, int, 3>>();
+    probe_test<hl::hashlist<int, int, 600>>();
+    probe_test<hl::hashlist<int, int, 600,  incremental>>();
+    probe_test<hl::hashlist<int, int, 3,    hl::FNV_1<int>, hl::group_probing>>();
+    probe_test<hl::hashlist<int, int, 100,  hl::FNV_1<int>, hl::group_probing>>();
+    probe_test<hl::hashlist<int, int, 600,  incremental,    hl::group_probing>>();
+    
+    // Displacing policy
+    probe_test<hl::hashlist<int, int, 1,    hl::FNV_1<int>,             hl::robin_hood>>();
+    probe_test<hl::hashlist<int, int, 8,    hl::FNV_1<int>,             hl::robin_hood>>();
+    probe_test<hl::hashlist<int, int, 64,   incremental,                hl::robin_hood>>();
+    probe_test<hl::hashlist<int, int, 600,  hl::Fibonacci_hash<int>,    hl::robin_hood>>();
+    probe_test<hl::hashlist<int, int, 1024, hl::Multiply_mix_hash<int>, hl::robin_hood>>();
     
-    using hl_t = hl::hashlist<size_t, dummy_t, 1_KIB>;
+    // Single-pass hash policies
+    probe_test<hl::hashlist<int, int, 64,   hl::Fibonacci_hash<int>,    hl::group_probing>>();
+    probe_test<hl::hashlist<int, int, 600,  hl::Fibonacci_hash<int>>>();
+    probe_test<hl::hashlist<int, int, 64,   hl::CRC32C_hash<int>>>();
+    probe_test<hl::hashlist<int, int, 600,  hl::Multiply_mix_hash<int>>>();
+    probe_test<hl::hashlist<int, int, 64,   hl::CRC32C_hash<int>,       hl::group_probing>>();
+    probe_test<hl::hashlist<int, int, 100,  hl::Multiply_mix_hash<int>, hl::group_probing>>();
     
+    // Layouts: fingerprints and values follow relocations
+    probe_test<hl::hashlist<int, int, 64,   hl::FNV_1<int>,          hl::double_hashing, hl::no_stats, hl::split<>>>();
+    probe_test<hl::hashlist<int, int, 100,  hl::FNV_1<int>,          hl::group_probing,  hl::no_stats, hl::split<>>>();
+    probe_test<hl::hashlist<int, int, 600,  hl::Fibonacci_hash<int>, hl::robin_hood,     hl::no_stats, hl::split<>>>();
+    probe_test<hl::hashlist<int, int, 600,  hl::FNV_1<int>,          hl::double_hashing, hl::no_stats, hl::split<0>>>();
+    probe_test<hl::hashlist<int, int, 64,   incremental,             hl::robin_hood,     hl::no_stats, hl::interleaved<64>>>();
+    
+    {
+        // Every slot of non 2^n table is reachable
+        using hln_t = hl::hashlist<int, int, 1000>;
+        hln_t nl;
+        for(int i = 0; i < 1000; ++i)
+            nl.emplace_back(i*7, i);
+        LIGHT_TEST(nl.size() == nl.max_size());
+        
+        bool overflow = false;
+        try {
+            nl.emplace_back(-1, -1);
+        } catch(std::bad_alloc&) {
+            overflow = true;
+        }
+        LIGHT_TEST(overflow == true);
+        for(int i = 0; i < 1000; ++i)
+            LIGHT_TEST(nl.find(i*7)->second == i);
+        
+        // Incremental keys are placed one after another
+        using hli_t = hl::hashlist<int, int, 1000, incremental>;
+        hli_t il;
+        for(int i = 0; i < 1000; ++i)
+            LIGHT_TEST(il.offset_of_element(il.emplace_back(i, i)) == size_t(i + 1));
+    }
+    
+    {
+        // Control bytes: full table, misses and tombstones
+        using hlg_t = hl::hashlist<int, int, 256, hl::FNV_1<int>, hl::group_probing>;
+        hlg_t gl;
+        
+        LIGHT_TEST(std::is_standard_layout<hlg_t>::value);
+        
+        for(int i = 0; i < 256; ++i)
+            gl.emplace_back(i, -i);
+        
+        bool overflow = false;
+        try {
+            gl.emplace_back(-1, -1);
+        } catch(std::bad_alloc&) {
+            overflow = true;
+        }
+        LIGHT_TEST(overflow == true);
+        
+        for(int i = -256; i < 512; ++i)
+            LIGHT_TEST((gl.find(i) != gl.end()) == (i >= 0 && i < 256));
+        
+        for(int i = 0; i < 256; i += 2)
+            gl.erase(gl.find(i));
+        LIGHT_TEST(gl.tombstones() == 128);
+        
+        gl.rehash();
+        LIGHT_TEST(gl.tombstones() == 0);
+        int expected = 1;
+        for(auto const& p : gl) {
+            LIGHT_TEST(p.first == expected);
+            LIGHT_TEST(gl.find(p.first)->second == -expected);
+            expected += 2;
+        }
+    }
+    
+    {
+        // Displacement keeps adding order, erase() follows relocated next
+        using hlr_t = hl::hashlist<int, int, 4096, hl::Fibonacci_hash<int>, hl::robin_hood>;
+        std::unique_ptr<hlr_t> prl(new hlr_t);
+        auto& rl = *prl;
+        std::vector<int> keys;
+        for(int i = 0; i < 4096*95/100; ++i)
+            keys.push_back(std::rand());
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        std::random_shuffle(keys.begin(), keys.end());
+        
+        for(int k : keys)
+            rl.emplace_back(k, -k);
+        LIGHT_TEST(std::equal(keys.begin(), keys.end(), rl.begin(),
+            [](int k, hlr_t::value_type const& p) { return p.first == k && p.second == -k; }));
+        
+        size_t i = 0;
+        for(auto it = rl.begin(); it != rl.end(); ++i) {
+            LIGHT_TEST(it->first == keys[i]);
+            if(i % 2 == 0)
+                it = rl.erase(it);
+            else
+                ++it;
+        }
+        LIGHT_TEST(rl.size() == keys.size()/2);
+        for(i = 0; i < keys.size(); ++i)
+            LIGHT_TEST((rl.find(keys[i]) != rl.end()) == (i % 2 == 1));
+        
+        // Full table
+        for(int k = 0; rl.size() < rl.max_size(); ++k)
+            if(rl.find(k) == rl.end())
+                rl.emplace_back(k, -k);
+        for(auto const& p : rl)
+            LIGHT_TEST(rl.find(p.first)->second == p.second);
+    }
+}
+
+/// Unique keys churn through upsert API against std::map + adding order
+template <typename hl_t>
+void upsert_test(int domain) {
+    hl_t rl;
+    std::map<int, int> sm;
+    std::list<int> order;
+    
+    for(int i = 0; i < 8192; ++i) {
+        int key = std::rand() % domain;
+        bool present = sm.count(key) != 0;
+        bool full = sm.size() == rl.max_size();
+        
+        switch(std::rand() % 4) {
+        case 0: {
+            auto result = rl.try_emplace_back(key, i);
+            LIGHT_TEST(result.second == (!present && !full));
+            LIGHT_TEST((result.first == rl.end()) == (!present && full));
+            if(result.second) {
+                sm[key] = i;
+                order.push_back(key);
+            }
+            if(result.first != rl.end())
+                LIGHT_TEST(result.first->first == key && result.first->second == sm[key]);
+            break;
+        }
+        case 1: {
+            auto result = rl.insert_or_assign(key, i);
+            LIGHT_TEST(result.second == (!present && !full));
+            if(present || !full) {
+                if(!present)
+                    order.push_back(key);
+                sm[key] = i;
+                LIGHT_TEST(result.first->second == i);
+            }
+            break;
+        }
+        case 2:
+            if(present || !full) {
+                if(!present) {
+                    order.push_back(key);
+                    sm[key] = 0;
+                }
+                LIGHT_TEST(rl[key] == sm[key]);
+                rl[key] += 1;
+                sm[key] += 1;
+            } else {
+                bool thrown = false;
+                try {
+                    rl[key] = 0;
+                } catch(std::bad_alloc&) {
+                    thrown = true;
+                }
+                LIGHT_TEST(thrown);
+            }
+            break;
+        default:
+            LIGHT_TEST(rl.erase(key) == sm.erase(key));
+            order.remove(key);
+        }
+        
+        LIGHT_TEST(rl.size() == sm.size());
+        if(i % 64 == 0) {
+            LIGHT_TEST(std::equal(order.begin(), order.end(), rl.begin(),
+                [&sm](int k, typename hl_t::value_type const& p) {
+                    return p.first == k && p.second == sm[k]; }));
+        }
+    }
+}
+
+void upsert_policies_test() {
+    upsert_test<hl::hashlist<int, int, 64>>(128);
+    upsert_test<hl::hashlist<int, int, 600>>(1200);
+    upsert_test<hl::hashlist<int, int, 64,  hl::FNV_1<int>, hl::group_probing>>(128);
+    upsert_test<hl::hashlist<int, int, 100, hl::FNV_1<int>, hl::group_probing>>(200);
+    upsert_test<hl::hashlist<int, int, 64,  hl::FNV_1<int>, hl::robin_hood>>(128);
+    upsert_test<hl::hashlist<int, int, 600, hl::FNV_1<int>, hl::robin_hood>>(1200);
+    upsert_test<hl::direct_hashlist<int, int, 0, 255>>(256);
+    
+    // Default constructed and multi-argument values
+    hl::hashlist<int, std::pair<int, int>, 16> pl;
+    LIGHT_TEST(pl[1] == std::make_pair(0, 0));
+    LIGHT_TEST(pl.try_emplace_back(2, 3, 4).first->second == std::make_pair(3, 4));
+    LIGHT_TEST(pl.emplace_back(5, 6, 7)->second.second == 7);
+}
+
+template <typename hl_t>
+void stats_test() {
     hl_t l;
+    std::vector<int> keys;
+    for(int k = 0; k < int(hl_t::max_size()); ++k)
+        keys.push_back(k*7 - 300);
+    std::random_shuffle(keys.begin(), keys.end());
+    keys.resize(hl_t::max_size() * 9 / 10);
+    
+    for(int k : keys)
+        l.emplace_back(k, k);
+    LIGHT_TEST(l.stats().inserts.walks == keys.size());
+    LIGHT_TEST(l.stats().peak_size == keys.size());
+    
+    // Lookups of stored keys walk exactly the way diagnostics() does
+    for(int k : keys)
+        LIGHT_TEST(l.find(k)->second == k);
+    auto d = l.diagnostics();
+    auto const& hits = l.stats().find_hits;
+    LIGHT_TEST(hits.walks == keys.size() && l.stats().find_misses.walks == 0);
+    LIGHT_TEST(std::fabs(hits.mean() - d.hit_probes) < 1e-9);
+    LIGHT_TEST(d.hit_probes >= 1.0 && d.miss_probes >= 1.0);
+    LIGHT_TEST(d.expected_hit_probes >= 1.0 && d.expected_miss_probes >= d.expected_hit_probes);
     
-    const size_t size = hl_t::max_size();
-    const size_t runs = 256;
+    size_t clusters = 0;
+    for(size_t i = 0; i < d.clusters.size(); ++i)
+        clusters += d.clusters[i];
+    LIGHT_TEST(clusters == d.cluster_count && d.max_cluster <= d.capacity);
+    LIGHT_TEST(d.size == keys.size() && std::fabs(d.mean_cluster * d.cluster_count - d.size) < 1e-6);
     
-    std::array<std::array<size_t, size>, runs> allocations;
-    std::array<size_t, runs> rows;
+    LIGHT_TEST(l.find(2) == l.end() && l.stats().find_misses.walks == 1);
+    LIGHT_TEST(l.erase(keys.front()) == 1 && l.stats().erasures == 1);
+    
+    l.reset_stats();
+    LIGHT_TEST(l.stats().find_hits.walks == 0 && l.stats().inserts.probes == 0);
+}
+
+void stats_policies_test() {
+    static_assert(std::is_empty<hl::no_stats>::value, "");
+    static_assert(std::is_standard_layout<hl::hashlist<int, int, 64>>::value, "");
     
-    for(size_t r = 0; r < runs; ++r) {
+    {
+        // Incremental keys are placed without collisions
+        using incremental = hl::Incremental_integer_fasthash<int>;
+        hl::hashlist<int, int, 64, incremental, hl::double_hashing, hl::probe_stats> l;
+        for(int k = 0; k < 32; ++k)
+            l.emplace_back(k, k);
+        auto const& stats = l.stats();
+        LIGHT_TEST(stats.inserts.walks == 32 && stats.inserts.counts[1] == 32 && stats.inserts.mean() == 1.0);
+        
+        for(int k = 0; k < 40; ++k)
+            l.find(k);
+        LIGHT_TEST(stats.find_hits.walks == 32 && stats.find_hits.probes == 32);
+        LIGHT_TEST(stats.find_misses.walks == 8 && stats.find_misses.probes == 8);
+        
+        auto d = l.diagnostics();
+        LIGHT_TEST(d.size == 32 && d.tombstones == 0 && d.capacity == 64);
+        LIGHT_TEST(d.cluster_count == 1 && d.clusters[5] == 1 && d.max_cluster == 32);
+        LIGHT_TEST(d.hit_probes == 1.0);
+        LIGHT_TEST(std::fabs(d.expected_hit_probes - 2*std::log(2.0)) < 1e-9 && d.expected_miss_probes == 2.0);
+        
+        // Cluster wraps around the end of index
         l.clear();
-        auto& run = allocations[r];
+        for(int k = 60; k < 68; ++k)
+            l.emplace_back(k, k);
+        d = l.diagnostics();
+        LIGHT_TEST(d.cluster_count == 1 && d.max_cluster == 8);
+        
+        // Failures are counted by both throwing and non-throwing insertions
+        for(int k = 0; l.size() < l.max_size(); ++k)
+            l.try_emplace_back(k, k);
+        LIGHT_TEST(stats.insert_failures == 0 && stats.peak_size == 64);
+        try {
+            l.emplace_back(1000, 0);
+        } catch(std::bad_alloc&) {}
+        LIGHT_TEST(l.try_emplace_back(1001, 0).first == l.end());
+        LIGHT_TEST(stats.insert_failures == 2);
         
-        auto row = rdtsc();
-        for(size_t i = 0; i < size; ++i) {
-            auto t = rdtsc();
-            volatile size_t vi = i;
-            i = vi;
+        l.reset_stats();
+        l.erase(l.begin());
+        LIGHT_TEST(stats.erasures == 1 && stats.peak_tombstones == 1 && stats.insert_failures == 0);
+    }
+    
+    stats_test<hl::hashlist<int, int, 1024, hl::Fibonacci_hash<int>,    hl::double_hashing, hl::probe_stats>>();
+    stats_test<hl::hashlist<int, int, 600,  hl::FNV_1<int>,             hl::double_hashing, hl::probe_stats>>();
+    stats_test<hl::hashlist<int, int, 1024, hl::Multiply_mix_hash<int>, hl::group_probing,  hl::probe_stats>>();
+    stats_test<hl::hashlist<int, int, 600,  hl::FNV_1<int>,             hl::robin_hood,     hl::probe_stats>>();
+}
+
+void bulk_erase_test() {
+    {
+        // Destructors are called once per element
+        using hl_t = hl::hashlist<int, counter, 64>;
+        counter::ctor_counter = counter::dtor_counter = 0;
+        {
+            hl_t l;
+            for(int k = 0; k < 50; ++k)
+                l.emplace_back(k, k);
             
-            l.emplace_back(i, char(i));
-            auto back = l.back();
+            auto next = l.erase(std::next(l.begin(), 10), std::next(l.begin(), 20));
+            LIGHT_TEST(next->first == 20 && l.size() == 40 && counter::dtor_counter == 10);
+            LIGHT_TEST(l.find(15) == l.end() && l.find(20) == next);
+            LIGHT_TEST(l.erase(next, next) == next && l.size() == 40);
             
-            volatile auto b1 = back.first;
-            volatile auto b2 = back.second.data[0];
-            volatile auto b3 = back.second.data[l.back().second.data.size() - 1];
-            b1 = b2 = b3 = b1;
+            l.pop_front(5);
+            LIGHT_TEST(l.front().first == 5 && l.size() == 35 && counter::dtor_counter == 15);
+            l.pop_front();
+            LIGHT_TEST(l.front().first == 6 && counter::dtor_counter == 16);
             
-            run[i] = rdtsc() - t;
+            l.erase(std::next(l.begin(), 30), l.end());
+            LIGHT_TEST(l.back().first == 45 && l.size() == 30 && counter::dtor_counter == 20);
+            
+            l.pop_front(100);
+            LIGHT_TEST(l.empty() && l.tombstones() == 0 && counter::dtor_counter == 50);
+            
+            l.emplace_back(1, 1);
+            l.emplace_back(2, 2);
+            l.clear();
+            LIGHT_TEST(l.empty() && l.find(1) == l.end() && counter::dtor_counter == 52);
+            l.emplace_back(3, 3);
         }
-        rows[r] = rdtsc() - row;
+        LIGHT_TEST(counter::ctor_counter == counter::dtor_counter);
     }
     
-    std::ofstream out;
-    out.open("perf.txt");
-    out << "emplace";
-    for(size_t s = 0; s < size; ++s)
-        out << "\t" << (s + 1);
-    out << "\n";
-    for(size_t r = 1; r < runs; ++r) {
-        out << r;
-        for(auto push : allocations[r])
-            out << "\t" << push;
-        out << "\n";
+    {
+        // Trivially destructible: clear() resets index as a whole
+        using hl_t = hl::hashlist<int, int, 256, hl::FNV_1<int>, hl::group_probing>;
+        hl_t l;
+        for(int round = 0; round < 100; ++round) {
+            for(int k = 0; k < 200; ++k)
+                l.emplace_back(k + round, k);
+            for(int k = 0; k < 200; k += 7)
+                l.erase(k + round);
+            l.clear();
+            LIGHT_TEST(l.empty() && l.size() == 0 && l.tombstones() == 0);
+            LIGHT_TEST(l.begin() == l.end() && l.find(round + 1) == l.end());
+        }
+        
+        l.emplace_back(1, 1);
+        l.erase(l.begin(), l.end());
+        LIGHT_TEST(l.empty() && l.tombstones() == 0);
     }
-    out << "\n\n";
+}
+
+template <typename hl_t>
+void compact_test(int domain) {
+    hl_t l;
+    std::vector<int> order;
+    for(int i = 0; i < 8*int(l.max_size()); ++i) {
+        int key = std::rand() % domain;
+        auto found = l.find(key);
+        if(found != l.end())
+            l.erase(found);
+        else if(l.size() < l.max_size() * 9 / 10)
+            l.emplace_back(key, i);
+    }
+    for(auto const& p : l)
+        order.push_back(p.first);
     
-    size_t findLF = 10;
+    l.compact();
+    LIGHT_TEST(l.size() == order.size() && l.tombstones() == 0);
+    LIGHT_TEST(std::equal(order.begin(), order.end(), l.begin(),
+        [](int k, typename hl_t::value_type const& p) { return p.first == k; }));
+    for(int k : order)
+        LIGHT_TEST(l.find(k)->first == k);
     
-    for(size_t r = 1; r <= findLF; ++r) {
-        l.clear();
+    // Ordered walk with prefetching
+    std::vector<int> walked;
+    static_cast<hl_t const&>(l).for_each([&](typename hl_t::value_type const& p) {
+        walked.push_back(p.first); });
+    LIGHT_TEST(walked == order);
+    l.for_each([](typename hl_t::value_type& p) { p.second = -p.first; });
+    LIGHT_TEST(l.find(order.back())->second == -order.back());
+    
+    int missing = 0;
+    while(l.find(missing) != l.end())
+        ++missing;
+    l.emplace_back(missing, 0);
+    LIGHT_TEST(l.back().first == missing && l.find(missing) == --l.end());
+}
+
+void compact_policies_test() {
+    {
+        // Displaced incremental keys return to their home cells
+        using hl_t = hl::hashlist<int, std::string, 64, hl::Incremental_integer_fasthash<int>>;
+        hl_t l;
+        l.emplace_back(64, "x");
+        for(int k = 0; k < 10; ++k)
+            l.emplace_back(k, std::to_string(k));
+        LIGHT_TEST(l.offset_of_element(l.find(0)) == 2);
+        l.erase(l.begin());
+        
+        l.compact();
+        LIGHT_TEST(l.tombstones() == 0 && l.size() == 10);
+        int expected = 0;
+        for(auto it = l.begin(); it != l.end(); ++it, ++expected) {
+            LIGHT_TEST(it->first == expected && it->second == std::to_string(expected));
+            LIGHT_TEST(l.offset_of_element(it) == size_t(1 + expected));
+        }
+        
+        hl_t empty;
+        empty.compact();
+        LIGHT_TEST(empty.empty());
+    }
+    
+    compact_test<hl::hashlist<int, int, 64>>(192);
+    compact_test<hl::hashlist<int, int, 600,  hl::FNV_1<int>>>(1800);
+    compact_test<hl::hashlist<int, int, 1024, hl::Fibonacci_hash<int>, hl::group_probing>>(3072);
+    compact_test<hl::hashlist<int, int, 100,  hl::FNV_1<int>,          hl::group_probing>>(300);
+    compact_test<hl::hashlist<int, int, 600,  hl::FNV_1<int>,          hl::robin_hood>>(1800);
+    compact_test<hl::direct_hashlist<int, int, 0, 1023>>(1024);
+    compact_test<hl::hashlist<int, int, 600,  hl::FNV_1<int>,          hl::double_hashing, hl::no_stats, hl::split<>>>(1800);
+    compact_test<hl::hashlist<int, int, 100,  hl::FNV_1<int>,          hl::group_probing,  hl::no_stats, hl::split<>>>(300);
+}
+
+template <typename hl_t>
+void unordered_test(int domain) {
+    std::unique_ptr<hl_t> lp(new hl_t);
+    hl_t& l = *lp;
+    for(int i = 0; i < 4*int(l.max_size()); ++i) {
+        int key = std::rand() % domain;
+        auto found = l.find(key);
+        if(found != l.end())
+            l.erase(found);
+        else if(l.size() < l.max_size() * 9 / 10)
+            l.emplace_back(key, key);
+    }
+    std::vector<int> expected;
+    long long sum = 0;
+    for(auto const& p : l) {
+        expected.push_back(p.first);
+        sum += p.second;
+    }
+    std::sort(expected.begin(), expected.end());
+    
+    // Storage order visits every element once
+    std::vector<int> visited;
+    static_cast<hl_t const&>(l).for_each_unordered([&](typename hl_t::value_type const& p) {
+        visited.push_back(p.first); });
+    std::sort(visited.begin(), visited.end());
+    LIGHT_TEST(visited == expected);
+    
+    // Split ranges cover all slots
+    visited.clear();
+    const size_t step = l.max_size() / 7 + 1;
+    for(size_t first = 0; first < l.max_size(); first += step)
+        l.for_each_in_slots(first, std::min(first + step, l.max_size()),
+            [&](typename hl_t::value_type const& p) { visited.push_back(p.first); });
+    std::sort(visited.begin(), visited.end());
+    LIGHT_TEST(visited == expected);
+    
+    for(size_t threads : {size_t(1), size_t(4), size_t(0)}) {
+        long long total = hl::parallel_transform_reduce(l, 0LL,
+            [](typename hl_t::value_type const& p) { return (long long)p.second; },
+            [](long long a, long long b) { return a + b; }, threads);
+        LIGHT_TEST(total == sum);
+    }
+    
+    hl::parallel_for_each(l, [](typename hl_t::value_type& p) { p.second = -p.first; }, 4);
+    for(auto const& p : l)
+        LIGHT_TEST(p.second == -p.first);
+    
+    bool thrown = false;
+    try {
+        hl::parallel_transform_reduce(l, 0, [](typename hl_t::value_type const&) -> int {
+            throw std::runtime_error("map"); }, [](int a, int b) { return a + b; }, 4);
+    } catch(std::runtime_error const&) {
+        thrown = true;
+    }
+    LIGHT_TEST(thrown == !l.empty());
+}
+
+void unordered_policies_test() {
+    unordered_test<hl::hashlist<int, int, 64>>(192);
+    unordered_test<hl::hashlist<int, int, 100,     hl::FNV_1<int>,          hl::group_probing>>(300);
+    unordered_test<hl::hashlist<int, int, 1 << 16>>(3 << 16);
+    unordered_test<hl::hashlist<int, int, 1 << 16, hl::Fibonacci_hash<int>, hl::group_probing>>(3 << 16);
+    unordered_test<hl::hashlist<int, int, 50000,   hl::FNV_1<int>,          hl::robin_hood>>(150000);
+    unordered_test<hl::direct_hashlist<int, int, 0, 99999>>(100000);
+    
+    hl::hashlist<int, int, 16> empty;
+    LIGHT_TEST(hl::parallel_transform_reduce(empty, 7, [](std::pair<const int, int> const&) { return 1; },
+        [](int a, int b) { return a + b; }) == 7);
+}
+
+/// Copy constructor throws when countdown runs out
+struct fragile {
+    static int countdown;
+    static int alive;
+    std::string data;
+    
+    fragile(std::string d) : data(std::move(d)) { ++alive; }
+    
+    fragile(fragile const& other) : data(other.data) {
+        if(--countdown == 0)
+            throw std::runtime_error("fragile");
+        ++alive;
+    }
+    
+    fragile(fragile&& other) : data(std::move(other.data)) { ++alive; }
+    
+    ~fragile() { --alive; }
+    
+    bool operator==(fragile const& other) const {
+        return data == other.data; }
+};
+int fragile::countdown = -1;
+int fragile::alive = 0;
+
+template <class hl_t>
+bool same_cells(hl_t const& lh, hl_t const& rh) {
+    if(lh != rh)
+        return false;
+    for(auto l = lh.begin(), r = rh.begin(); l != lh.end(); ++l, ++r)
+        if(lh.offset_of_element(l) != rh.offset_of_element(r))
+            return false;
+    return true;
+}
+
+void copy_test() {
+    {
+        // Trivially copyable: block copy keeps cells and tombstones
+        using hl_t = hl::hashlist<int, int, 256>;
+        hl_t l;
+        for(int k = 0; k < 200; ++k)
+            l.emplace_back(k, -k);
+        for(int k = 0; k < 200; k += 3)
+            l.erase(k);
+        l.move_to_front(l.find(100));
+        
+        hl_t copy(l);
+        LIGHT_TEST(same_cells(l, copy) && copy.tombstones() == l.tombstones());
+        LIGHT_TEST(copy.find(100) == copy.begin() && copy.find(3) == copy.end());
+        copy.emplace_back(1000, 1);
+        LIGHT_TEST(copy.back().second == 1 && l.find(1000) == l.end());
+        
+        hl_t assigned;
+        assigned.emplace_back(-1, -1);
+        assigned = l;
+        LIGHT_TEST(same_cells(l, assigned) && assigned.find(-1) == assigned.end());
         
-        auto& run = allocations[r];
-        size_t sizeLF = size*r/findLF;
+        hl_t moved(std::move(copy));
+        LIGHT_TEST(copy.empty() && copy.begin() == copy.end() && copy.find(1) == copy.end());
+        LIGHT_TEST(moved.size() == l.size() + 1 && moved.back().first == 1000);
         
-        for(size_t i = 0; i < sizeLF; ++i)
-            l.emplace_back(i, char(i));
+        copy = std::move(moved);
+        LIGHT_TEST(moved.empty() && copy.size() == l.size() + 1);
         
-        for(size_t i = 0; i < size; ++i) {
-            auto key = std::rand() % (sizeLF);
+        swap(copy, assigned);
+        LIGHT_TEST(same_cells(l, copy) && assigned.back().first == 1000);
+    }
+    
+    {
+        // Elements are constructed in the same cells
+        using hl_t = hl::hashlist<int, std::string, 64, hl::FNV_1<int>, hl::robin_hood>;
+        hl_t l;
+        for(int k = 0; k < 60; ++k)
+            l.emplace_back(k, std::to_string(k) + std::string(20, 'x'));
+        for(int k = 0; k < 60; k += 4)
+            l.erase(k);
+        
+        hl_t copy(l);
+        LIGHT_TEST(same_cells(l, copy));
+        copy.find(1)->second = "one";
+        LIGHT_TEST(l.find(1)->second != "one");
+        for(auto const& p : l)
+            LIGHT_TEST(copy.find(p.first) != copy.end());
+        
+        hl_t moved(std::move(copy));
+        LIGHT_TEST(copy.empty() && moved.find(1)->second == "one" && moved.size() == l.size());
+        moved = l;
+        LIGHT_TEST(same_cells(l, moved));
+    }
+    
+    {
+        // Throwing copy leaves no elements behind
+        using hl_t = hl::hashlist<int, fragile, 32>;
+        {
+            hl_t l;
+            for(int k = 0; k < 20; ++k)
+                l.emplace_back(k, std::to_string(k));
+            LIGHT_TEST(fragile::alive == 20);
+            
+            fragile::countdown = 10;
+            bool thrown = false;
+            try {
+                hl_t copy(l);
+            } catch(std::runtime_error&) {
+                thrown = true;
+            }
+            LIGHT_TEST(thrown && fragile::alive == 20);
+            
+            hl_t assigned;
+            assigned.emplace_back(-1, "x");
+            fragile::countdown = 5;
+            try {
+                assigned = l;
+            } catch(std::runtime_error&) {}
+            LIGHT_TEST(assigned.empty() && fragile::alive == 20);
             
-            auto t = rdtsc();
+            fragile::countdown = -1;
+            assigned = l;
+            LIGHT_TEST(same_cells(l, assigned) && fragile::alive == 40);
+        }
+        LIGHT_TEST(fragile::alive == 0);
+    }
+}
+
+void snapshot_test() {
+    using hl_t = hl::hashlist<int, double, 512, hl::Fibonacci_hash<int>, hl::group_probing>;
+    hl_t l;
+    for(int k = 0; k < 400; ++k)
+        l.emplace_back(k*k, k / 2.0);
+    for(int k = 0; k < 400; k += 5)
+        l.erase(k*k);
+    l.move_to_back(l.begin());
+    
+    std::stringstream stream;
+    l.save(stream);
+    
+    hl_t loaded;
+    loaded.emplace_back(-1, 0.0);
+    loaded.load(stream);
+    LIGHT_TEST(same_cells(l, loaded) && loaded.tombstones() == l.tombstones());
+    LIGHT_TEST(loaded.find(-1) == loaded.end() && loaded.find(49)->second == 3.5);
+    loaded.emplace_back(-1, 0.0);
+    LIGHT_TEST(loaded.size() == l.size() + 1);
+    
+    // Broken and foreign snapshots are rejected, container is left empty
+    auto rejected = [&](std::string const& data) {
+        std::stringstream in(data);
+        try {
+            loaded.load(in);
+        } catch(std::runtime_error&) {
+            return loaded.empty() && loaded.find(49) == loaded.end();
+        }
+        return false;
+    };
+    std::string bytes = stream.str();
+    LIGHT_TEST(rejected(bytes.substr(0, bytes.size() / 2)));
+    LIGHT_TEST(rejected(bytes.substr(0, 10)));
+    LIGHT_TEST(rejected(std::string(bytes.size(), 'x')));
+    {
+        hl::hashlist<int, double, 512> other;
+        std::stringstream out;
+        other.save(out);
+        LIGHT_TEST(rejected(out.str()));
+    }
+    
+    // File descriptor
+    FILE* file = std::tmpfile();
+    LIGHT_TEST(file != nullptr);
+    l.save(fileno(file));
+    LIGHT_TEST(lseek(fileno(file), 0, SEEK_SET) == 0);
+    loaded.load(fileno(file));
+    LIGHT_TEST(same_cells(l, loaded));
+    std::fclose(file);
+}
+
+/// Value spanning several cache lines
+struct wide_value {
+    int id;
+    char payload[196];
+    
+    bool operator==(wide_value const& other) const {
+        return id == other.id && std::memcmp(payload, other.payload, sizeof(payload)) == 0; }
+};
+
+/// Keys of the same residue share h1: equal fingerprints of different keys
+struct residue_hash {
+    static uint64_t h1(int k) { return uint64_t(k % 5) * 0x100000001UL; }
+    static uint32_t h2(int)   { return 1; }
+};
+
+template <typename hl_t>
+void fingerprint_test() {
+    hl_t l;
+    for(int k = 0; k < 40; ++k)
+        l.emplace_back(k, std::to_string(k));
+    for(int k = 0; k < 40; k += 4)
+        l.erase(k);
+    l.emplace_back(7, "seven");
+    
+    for(int k = 0; k < 40; ++k)
+        LIGHT_TEST(k % 4 == 0 ? l.find(k) == l.end() : k == 7 || l.find(k)->second == std::to_string(k));
+    LIGHT_TEST(l.count(7) == 2 && l.count(12) == 0 && l.find(45) == l.end());
+    
+    hl_t copy(l);
+    LIGHT_TEST(same_cells(l, copy));
+    for(auto const& p : l)
+        LIGHT_TEST(copy.count(p.first) == l.count(p.first));
+    copy.erase(7);
+    LIGHT_TEST(copy.count(7) == 1 && l.count(7) == 2);
+}
+
+void layout_test() {
+    {
+        // Hot/cold arrays: iterators reach values through their cursor
+        using hl_t = hl::hashlist<int, wide_value, 256, hl::FNV_1<int>,
+            hl::double_hashing, hl::no_stats, hl::split<>>;
+        static_assert(std::is_standard_layout<hl_t>::value && alignof(hl_t) == 64,
+            "split layout is standard layout aligned to cache line");
+        
+        hl_t l;
+        for(int k = 0; k < 200; ++k) {
+            wide_value v{};
+            v.id = -k;
+            v.payload[k % 196] = char(k);
+            l.emplace_back(k, v);
+        }
+        for(int k = 0; k < 200; k += 3)
+            l.erase(k);
+        l.move_to_front(l.find(100));
+        l.rehash();
+        
+        LIGHT_TEST(l.front().first == 100 && l.find(3) == l.end() && l.size() == 133);
+        for(auto const& p : l)
+            LIGHT_TEST(p.second.id == -p.first && p.second.payload[p.first % 196] == char(p.first));
+        
+        // Walks by links meet the same values forth and back
+        std::vector<int> forth, back, walked;
+        for(auto it = l.cbegin(); it != l.cend(); ++it)
+            forth.push_back(it->first);
+        for(auto it = l.rbegin(); it != l.rend(); ++it)
+            back.push_back(it->first);
+        std::reverse(back.begin(), back.end());
+        l.for_each([&](hl_t::value_type const& p) { walked.push_back(p.first); });
+        LIGHT_TEST(forth == back && forth == walked && forth.size() == l.size());
+        
+        hl_t::iterator a = l.find(1), b = l.find(2);
+        a.swap(b);
+        hl_t::const_iterator c = a;
+        LIGHT_TEST(c->second.id == -2 && b->second.id == -1 && (--c)->first == 1);
+        LIGHT_TEST(l.element_by_offset(l.offset_of_element(b))->second.id == -1);
+        
+        // Block copy and snapshot carry fingerprints along
+        hl_t copy(l);
+        LIGHT_TEST(same_cells(l, copy));
+        copy.find(1)->second.id = 1;
+        LIGHT_TEST(l.find(1)->second.id == -1);
+        
+        std::stringstream stream;
+        l.save(stream);
+        hl_t loaded;
+        loaded.load(stream);
+        LIGHT_TEST(same_cells(l, loaded) && loaded.find(199)->second.id == -199);
+        loaded.emplace_back(300, wide_value{});
+        LIGHT_TEST(loaded.back().first == 300 && loaded.find(300) == --loaded.end());
+        
+        // Layouts differ: snapshots aren't interchangeable
+        hl::hashlist<int, wide_value, 256> interleaved;
+        std::stringstream other;
+        interleaved.save(other);
+        bool thrown = false;
+        try {
+            loaded.load(other);
+        } catch(std::runtime_error&) {
+            thrown = true;
+        }
+        LIGHT_TEST(thrown && loaded.empty());
+    }
+    
+    {
+        // Non-trivial values are copied cell by cell
+        using hl_t = hl::hashlist<int, std::string, 64, hl::FNV_1<int>,
+            hl::group_probing, hl::no_stats, hl::split<>>;
+        hl_t l;
+        for(int k = 0; k < 60; ++k)
+            l.emplace_back(k, std::to_string(k) + std::string(20, 'x'));
+        for(int k = 0; k < 60; k += 4)
+            l.erase(k);
+        
+        hl_t copy(l);
+        LIGHT_TEST(same_cells(l, copy));
+        hl_t moved(std::move(copy));
+        LIGHT_TEST(copy.empty() && same_cells(l, moved));
+        swap(moved, copy);
+        LIGHT_TEST(moved.empty() && copy.find(59)->second == l.find(59)->second);
+        
+        std::vector<std::string> unordered;
+        l.for_each_unordered([&](hl_t::value_type const& p) { unordered.push_back(p.second); });
+        LIGHT_TEST(unordered.size() == l.size());
+    }
+    
+    static_assert(alignof(hl::hashlist<int, int, 64, hl::FNV_1<int>, hl::double_hashing,
+        hl::no_stats, hl::interleaved<64>>) == 64, "aligned cells");
+    
+    fingerprint_test<hl::hashlist<int, std::string, 64, residue_hash, hl::double_hashing, hl::no_stats, hl::split<>>>();
+    fingerprint_test<hl::hashlist<int, std::string, 64, residue_hash, hl::group_probing,  hl::no_stats, hl::split<>>>();
+    fingerprint_test<hl::hashlist<int, std::string, 64, residue_hash, hl::robin_hood,     hl::no_stats, hl::split<>>>();
+}
+
+/// Bulk emplacement against emplace_back() one by one
+template <typename hl_t>
+void range_test(int domain) {
+    const int n = int(hl_t::max_size());
+    std::vector<std::pair<int, int>> pairs;
+    for(int i = 0; i < 2*n; ++i)
+        pairs.emplace_back(std::rand() % domain, i);
+    
+    // Churned start: tombstones and relocations
+    hl_t bulk, single;
+    for(int i = 0; i < n / 2; ++i) {
+        bulk.emplace_back(-1 - i, i);
+        single.emplace_back(-1 - i, i);
+    }
+    for(int i = 0; i < n / 2; i += 3) {
+        bulk.erase(-1 - i);
+        single.erase(-1 - i);
+    }
+    
+    auto rest = bulk.emplace_back_range(pairs.begin(), pairs.end());
+    auto expected = pairs.begin();
+    try {
+        for(; expected != pairs.end(); ++expected)
+            single.emplace_back(expected->first, expected->second);
+    } catch(std::bad_alloc&) {}
+    LIGHT_TEST(rest == expected && rest != pairs.end());
+    LIGHT_TEST(bulk == single);
+    for(auto it = bulk.begin(); it != bulk.end(); ++it)
+        LIGHT_TEST(bulk.count(it->first) == single.count(it->first));
+    
+    LIGHT_TEST(bulk.emplace_back_range(pairs.end(), pairs.end()) == pairs.end());
+    LIGHT_TEST(bulk == single);
+    
+    auto half = pairs.begin() + n / 2;
+    LIGHT_TEST(bulk.assign(pairs.begin(), half) == half && bulk.size() == size_t(n / 2));
+    LIGHT_TEST(std::equal(bulk.begin(), bulk.end(), pairs.begin(),
+        [](typename hl_t::value_type const& p, std::pair<int, int> const& q) {
+            return p.first == q.first && p.second == q.second; }));
+    LIGHT_TEST(std::equal(bulk.rbegin(), bulk.rend(), std::reverse_iterator<decltype(half)>(half),
+        [](typename hl_t::value_type const& p, std::pair<int, int> const& q) { return p.second == q.second; }));
+    bulk.emplace_back(domain, -1);
+    LIGHT_TEST(bulk.back().first == domain && bulk.find(domain) == --bulk.end());
+}
+
+void range_policies_test() {
+    range_test<hl::hashlist<int, int, 64>>(128);
+    range_test<hl::hashlist<int, int, 600,  hl::FNV_1<int>>>(1200);
+    range_test<hl::hashlist<int, int, 100,  hl::FNV_1<int>,          hl::group_probing>>(200);
+    range_test<hl::hashlist<int, int, 1024, hl::Fibonacci_hash<int>, hl::group_probing>>(2048);
+    range_test<hl::hashlist<int, int, 600,  hl::FNV_1<int>,          hl::robin_hood>>(1200);
+    range_test<hl::hashlist<int, int, 600,  hl::FNV_1<int>,          hl::double_hashing, hl::probe_stats, hl::split<>>>(1200);
+    
+    {
+        // Unique keys stop at the first present one
+        hl::direct_hashlist<int, int, 0, 255> l;
+        std::vector<std::pair<int, int>> pairs;
+        for(int k = 0; k < 200; ++k)
+            pairs.emplace_back(k, -k);
+        pairs.emplace_back(10, 0);
+        pairs.emplace_back(201, 0);
+        LIGHT_TEST(l.assign(pairs.begin(), pairs.end()) == pairs.end() - 2);
+        LIGHT_TEST(l.size() == 200 && l.find(199)->second == -199 && l.back().first == 199);
+    }
+    
+    {
+        // Throwing element: placed ones stay linked
+        using hl_t = hl::hashlist<int, fragile, 64>;
+        {
+            std::vector<std::pair<int, fragile>> pairs;
+            for(int k = 0; k < 40; ++k)
+                pairs.emplace_back(k, fragile(std::to_string(k)));
+            int alive = fragile::alive;
+            
+            hl_t l;
+            l.emplace_back(-1, "x");
+            fragile::countdown = 25;
+            bool thrown = false;
+            try {
+                l.emplace_back_range(pairs.begin(), pairs.end());
+            } catch(std::runtime_error&) {
+                thrown = true;
+            }
+            fragile::countdown = -1;
+            LIGHT_TEST(thrown && l.size() == 25 && fragile::alive == alive + 25);
+            int expected = -1;
+            for(auto const& p : l)
+                LIGHT_TEST(p.first == expected++);
+            LIGHT_TEST(l.back().first == 23 && (--l.end())->first == 23);
+            l.emplace_back(100, "y");
+            LIGHT_TEST(l.back().first == 100 && l.find(23) != l.end());
+        }
+        LIGHT_TEST(fragile::alive == 0);
+    }
+}
+
+/// Composite key of B bytes, no padding
+template <size_t B>
+struct blob_key {
+    uint32_t words[B/4];
+    
+    bool operator==(blob_key const& other) const {
+        return std::equal(words, words + B/4, other.words); }
+};
+
+template <typename keyT>
+blob_key<sizeof(keyT)> make_blob(size_t i) {
+    blob_key<sizeof(keyT)> k;
+    for(size_t w = 0; w < sizeof(keyT)/4; ++w)
+        k.words[w] = uint32_t(w == 0 ? i : 0x5bd1e995U*w);
+    return k;
+}
+
+template <class Hash, size_t B>
+void blob_hash_test() {
+    using key_t = blob_key<B>;
+    using hl_t = hl::hashlist<key_t, size_t, 1024, Hash>;
+    hl_t l;
+    for(size_t i = 0; i < l.max_size()*3/4; ++i) {
+        auto k = make_blob<key_t>(i);
+        LIGHT_TEST(Hash::h2(k) % 2 == 1);
+        LIGHT_TEST(Hash::both(k).h1 == Hash::h1(k));
+        l.emplace_back(k, i);
+    }
+    for(size_t i = 0; i < l.max_size(); ++i) {
+        auto found = l.find(make_blob<key_t>(i));
+        LIGHT_TEST((found != l.end()) == (i < l.max_size()*3/4));
+        if(found != l.end())
+            LIGHT_TEST(found->second == i);
+    }
+}
+
+void hash_policies_test() {
+    {
+        // Hardware and portable CRC32C agree with reference value
+        uint64_t k;
+        std::memcpy(&k, "12345678", sizeof(k));
+        auto h = hl::CRC32C_hash<uint64_t>::both(k);
+        LIGHT_TEST(h.h1 == 0x6087809aUL*0x9e3779b97f4a7c15UL);
+        LIGHT_TEST(h.h2 == (uint32_t(h.h1 >> 32) | 1));
+    }
+    
+    blob_hash_test<hl::CRC32C_hash<blob_key<4>>, 4>();
+    blob_hash_test<hl::CRC32C_hash<blob_key<12>>, 12>();
+    blob_hash_test<hl::CRC32C_hash<blob_key<32>>, 32>();
+    blob_hash_test<hl::Multiply_mix_hash<blob_key<4>>, 4>();
+    blob_hash_test<hl::Multiply_mix_hash<blob_key<12>>, 12>();
+    blob_hash_test<hl::Multiply_mix_hash<blob_key<24>>, 24>();
+    blob_hash_test<hl::Multiply_mix_hash<blob_key<32>>, 32>();
+}
+
+void direct_test() {
+    static_assert(std::is_same<hl::hashlist<int, int, 8>::hasher, hl::Fibonacci_hash<int>>::value, "");
+    static_assert(std::is_same<hl::hashlist<blob_key<8>, int, 8>::hasher,
+        hl::Multiply_mix_hash<blob_key<8>>>::value, "");
+    static_assert(std::is_same<hl::default_hash<std::string>, hl::FNV_1<std::string>>::value, "");
+    
+    {
+        // Whole domain of uint8_t keys
+        using hld_t = hl::direct_hashlist<uint8_t, int>;
+        static_assert(hld_t::max_size() == 256, "");
+        hld_t dl;
+        std::vector<uint8_t> keys;
+        for(int k = 0; k < 256; ++k)
+            keys.push_back(uint8_t(k));
+        std::random_shuffle(keys.begin(), keys.end());
+        
+        for(auto k : keys)
+            dl.emplace_back(k, int(k));
+        LIGHT_TEST(dl.size() == 256);
+        LIGHT_TEST(std::equal(keys.begin(), keys.end(), dl.begin(),
+            [](uint8_t k, hld_t::value_type const& p) { return p.first == k; }));
+        for(int k = 0; k < 256; ++k)
+            LIGHT_TEST(dl.find(uint8_t(k))->second == k);
+        
+        dl.erase(dl.find(42));
+        LIGHT_TEST(dl.find(42) == dl.end());
+        dl.rehash();
+        dl.emplace_back(42, -42);
+        LIGHT_TEST(dl.back().second == -42 && dl.find(42) == --dl.end());
+    }
+    
+    {
+        // Declared range, keys are unique
+        using hld_t = hl::direct_hashlist<int, int, -100, 99>;
+        static_assert(hld_t::max_size() == 200, "");
+        hld_t dl;
+        dl.emplace_back(-100, 1);
+        dl.emplace_back(99, 2);
+        LIGHT_TEST(dl.find(-100)->second == 1 && dl.find(99)->second == 2);
+        LIGHT_TEST(dl.find(0) == dl.end() && dl.find(100) == dl.end() && dl.find(-101) == dl.end());
+        
+        size_t failures = 0;
+        for(int k : {-101, 100, 99}) {
+            try {
+                dl.emplace_back(k, 0);
+            } catch(std::bad_alloc&) {
+                ++failures;
+            }
+        }
+        LIGHT_TEST(failures == 3 && dl.size() == 2);
+    }
+}
+
+template <class cache_t>
+void lru_cache_test(cache_t& cache) {
+    LIGHT_TEST(cache.empty() && cache.capacity() == 4);
+    for(int k = 0; k < 4; ++k)
+        cache.put(k, k*10);
+    LIGHT_TEST(*cache.get(0) == 0);       // order: 1 2 3 0
+    LIGHT_TEST(cache.get(5) == nullptr);
+    cache.put(2, 22);                       // order: 1 3 0 2
+    cache.put(4, 40);                       // evicts 1
+    LIGHT_TEST(cache.peek(1) == nullptr && *cache.peek(2) == 22);
+    
+    std::vector<int> order;
+    for(auto const& p : cache)
+        order.push_back(p.first);
+    LIGHT_TEST((order == std::vector<int>{3, 0, 2, 4}));
+    
+    for(int k = 10; k < 14; ++k)
+        cache.put(k, k);
+    LIGHT_TEST(cache.size() == 4 && cache.peek(4) == nullptr && *cache.peek(13) == 13);
+    
+    auto stats = cache.stats();
+    LIGHT_TEST(stats.hits == 1 && stats.misses == 1 && stats.evictions == 5);
+    LIGHT_TEST(cache.erase(13) == 1 && cache.erase(13) == 0);
+}
+
+/// Arena-like stateful allocator counting live bytes of its arena
+template <typename T>
+struct counting_allocator {
+    using value_type = T;
+    
+    long* live;
+    
+    explicit counting_allocator(long* l) : live(l) {}
+    
+    template <typename U>
+    counting_allocator(counting_allocator<U> const& other) : live(other.live) {}
+    
+    T* allocate(size_t n) {
+        *live += long(n * sizeof(T));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    
+    void deallocate(T* p, size_t n) {
+        *live -= long(n * sizeof(T));
+        ::operator delete(p);
+    }
+    
+    template <typename U>
+    bool operator==(counting_allocator<U> const& other) const { return live == other.live; }
+    
+    template <typename U>
+    bool operator!=(counting_allocator<U> const& other) const { return live != other.live; }
+};
+
+/// Same propagating on container copy, move and swap
+template <typename T>
+struct propagating_allocator : counting_allocator<T> {
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    
+    explicit propagating_allocator(long* l) : counting_allocator<T>(l) {}
+    
+    template <typename U>
+    propagating_allocator(propagating_allocator<U> const& other) : counting_allocator<T>(other.live) {}
+};
+
+void dynamic_test() {
+    {
+        // Growth keeps order, values don't move, migration is spread over operations
+        hl::dynamic_hashlist<int, std::string> l;
+        LIGHT_TEST(l.empty() && l.capacity() == 0 && l.bucket_count() == 0 && l.find(1) == l.end());
+        
+        l.emplace_back(0, "0");
+        auto first = &l.front();
+        size_t growths = 0, max_steps = 0, steps = 0;
+        for(int k = 1; k < 100000; ++k) {
+            bool was = l.migrating();
+            l.emplace_back(k, std::to_string(k));
+            if(l.migrating()) {
+                growths += !was;
+                max_steps = std::max(max_steps, ++steps);
+                LIGHT_TEST(l.find(k / 2)->second == std::to_string(k / 2));
+                LIGHT_TEST(l.find(-k) == l.end());
+            } else {
+                steps = 0;
+            }
+        }
+        LIGHT_TEST(growths >= 10 && max_steps > 64);
+        LIGHT_TEST(&l.front() == first && l.size() == 100000);
+        LIGHT_TEST(l.capacity() >= l.size() && l.load_factor() <= 0.5f);
+        
+        int expected = 0;
+        for(auto const& p : l)
+            LIGHT_TEST(p.first == expected && p.second == std::to_string(expected++));
+        for(int k = 0; k < 100000; k += 7)
+            LIGHT_TEST(l.find(k)->first == k);
+        
+        // Idle draining
+        while(l.migrate(3));
+        LIGHT_TEST(!l.migrating() && l.find(99999)->second == "99999");
+    }
+    
+    {
+        // Churn against std::map, erased cells are reused
+        hl::dynamic_hashlist<int, int> l(1000);
+        std::map<int, int> m;
+        const size_t capacity = l.capacity(), buckets = l.bucket_count();
+        LIGHT_TEST(capacity >= 1000 && buckets >= 2000 && !l.migrating());
+        
+        for(int i = 0; i < 200000; ++i) {
+            int key = std::rand() % 1500;
             auto found = l.find(key);
-            volatile auto f1 = found->first;
-            volatile auto f2 = found->second.data[0];
-            volatile auto f3 = found->second.data[l.back().second.data.size() - 1];
-            f1 = f2 = f3 = f1;
-            run[i] = rdtsc() - t;
+            LIGHT_TEST((found == l.end()) == (m.count(key) == 0));
+            if(found != l.end()) {
+                LIGHT_TEST(found->second == m[key]);
+                if(i % 3 == 0)
+                    l.erase(found), m.erase(key);
+                else
+                    l.move_to_back(found);
+            } else if(m.size() < 1000) {
+                l.emplace_back(key, i);
+                m[key] = i;
+            }
+        }
+        LIGHT_TEST(l.size() == m.size() && l.capacity() == capacity);
+        
+        // Tombstones are dropped by same size migrations, index doesn't grow endlessly
+        LIGHT_TEST(l.bucket_count() <= 2*buckets);
+        for(auto const& p : m)
+            LIGHT_TEST(l.find(p.first)->second == p.second);
+        
+        auto r = l.try_emplace_back(m.begin()->first, -1);
+        LIGHT_TEST(!r.second && r.first->second == m.begin()->second);
+        r = l.insert_or_assign(5000, 1);
+        LIGHT_TEST(r.second && l.back().first == 5000);
+        l[5000] += 1;
+        l[5001] += 1;
+        LIGHT_TEST(l.find(5000)->second == 2 && l.back().second == 1);
+        l.move_to_front(l.find(5001));
+        LIGHT_TEST(l.front().first == 5001 && l.erase(5001) == 1 && l.erase(5001) == 0);
+    }
+    
+    {
+        // Allocator gets everything back, copies and moves keep order
+        long live = 0;
+        using alloc_t = counting_allocator<std::pair<const int, std::string>>;
+        using hld_t = hl::dynamic_hashlist<int, std::string, hl::FNV_1<int>, alloc_t>;
+        {
+            hld_t l(0, alloc_t(&live));
+            LIGHT_TEST(live == 0);
+            for(int k = 0; k < 5000; ++k)
+                l.emplace_back(k, std::string(40, char('a' + k % 26)));
+            LIGHT_TEST(live > 0 && l.get_allocator().live == &live);
+            
+            hld_t copy(l);
+            LIGHT_TEST(copy.size() == l.size() && copy.begin()->first == 0 && copy.back().first == 4999);
+            
+            hld_t moved(std::move(l));
+            LIGHT_TEST(l.empty() && l.begin() == l.end() && moved.size() == 5000);
+            l.emplace_back(1, "1");
+            LIGHT_TEST(l.size() == 1 && l.find(1) != l.end());
+            
+            swap(l, moved);
+            LIGHT_TEST(l.size() == 5000 && moved.size() == 1 && moved.begin()->first == 1);
+            LIGHT_TEST((--moved.end())->first == 1 && moved.rbegin()->first == 1);
+            
+            moved = l;
+            LIGHT_TEST(moved.size() == 5000 && moved.find(4321) != moved.end());
+            
+            l.clear();
+            LIGHT_TEST(l.empty() && l.find(7) == l.end() && l.capacity() > 0);
+            l.emplace_back(7, "7");
+            LIGHT_TEST(l.size() == 1 && l.find(7) == l.begin());
         }
+        LIGHT_TEST(live == 0);
     }
     
-    for(size_t s = 1; s <= findLF; ++s)
-        out << "\t" << s*10 << "%";
-    out << "\n";
-    for(size_t i = 0; i < size; ++i) {
-        for(size_t r = 1; r <= findLF; ++r)
-            out << "\t" << allocations[r][i];
-        out << "\n";
+    {
+        // Allocators are kept or taken by assignments and swaps as propagate_* traits say
+        long a = 0, b = 0;
+        using alloc_t = counting_allocator<std::pair<const int, std::string>>;
+        using hld_t = hl::dynamic_hashlist<int, std::string, hl::FNV_1<int>, alloc_t>;
+        {
+            hld_t la(0, alloc_t(&a)), lb(0, alloc_t(&b));
+            for(int k = 0; k < 1000; ++k)
+                la.emplace_back(k, std::to_string(k));
+            long a_used = a;
+            
+            lb = la;
+            LIGHT_TEST(lb.get_allocator().live == &b && b > 0 && a == a_used);
+            LIGHT_TEST(lb == la);
+            
+            hld_t lc(0, alloc_t(&b));
+            lc = std::move(la);
+            LIGHT_TEST(lc.get_allocator().live == &b && la.empty() && lc.size() == 1000);
+            LIGHT_TEST(lc.find(999)->second == "999" && lc == lb);
+        }
+        LIGHT_TEST(a == 0 && b == 0);
+        
+        using prop_t = propagating_allocator<std::pair<const int, std::string>>;
+        using hlp_t = hl::dynamic_hashlist<int, std::string, hl::FNV_1<int>, prop_t>;
+        {
+            hlp_t la(0, prop_t(&a)), lb(0, prop_t(&b));
+            for(int k = 0; k < 1000; ++k)
+                la.emplace_back(k, std::to_string(k));
+            lb.emplace_back(-1, "-1");
+            
+            swap(la, lb);
+            LIGHT_TEST(la.get_allocator().live == &b && lb.get_allocator().live == &a);
+            LIGHT_TEST(la.size() == 1 && lb.size() == 1000);
+            
+            la = lb;
+            LIGHT_TEST(la.get_allocator().live == &a && la == lb);
+            
+            hlp_t lc(0, prop_t(&b));
+            lc = std::move(la);
+            LIGHT_TEST(lc.get_allocator().live == &a && lc == lb);
+        }
+        LIGHT_TEST(a == 0 && b == 0);
     }
+}
+
+void lru_test() {
+    {
+        // Relinking keeps cells
+        hl::hashlist<int, int, 8> l;
+        for(int i = 0; i < 5; ++i)
+            l.emplace_back(i, i);
+        auto two = l.find(2);
+        auto offset = l.offset_of_element(two);
+        l.move_to_back(two);
+        l.move_to_front(l.find(4));
+        l.move_to_back(l.find(2));  // already last
+        l.move_to_front(l.find(4)); // already first
+        LIGHT_TEST(l.offset_of_element(two) == offset && two->second == 2);
+        
+        std::vector<int> order;
+        for(auto const& p : l)
+            order.push_back(p.first);
+        LIGHT_TEST((order == std::vector<int>{4, 0, 1, 3, 2}));
+        order.clear();
+        for(auto it = l.rbegin(); it != l.rend(); ++it)
+            order.push_back(it->first);
+        LIGHT_TEST((order == std::vector<int>{2, 3, 1, 0, 4}));
+        
+        hl::hashlist<int, int, 8> single;
+        single.emplace_back(1, 1);
+        single.move_to_back(single.begin());
+        single.move_to_front(single.begin());
+        LIGHT_TEST(single.size() == 1 && single.front().first == 1 && single.back().first == 1);
+    }
+    
+    {
+        hl::lru_cache<int, int, 4> cache;
+        lru_cache_test(cache);
+        hl::lru_cache<int, int, 4, hl::FNV_1<int>, hl::robin_hood> rcache;
+        lru_cache_test(rcache);
+    }
+    
+    {
+        // Values held across erase-heavy puts stay in place
+        hl::lru_cache<int, int, 64> cache;
+        for(int k = 0; k <= 40; ++k)
+            cache.put(k, k);
+        for(int k = 0; k <= 38; ++k)
+            cache.erase(k);
+        size_t tombstones = cache.container().tombstones();
+        int* a = cache.get(39);
+        int* b = cache.get(40);
+        LIGHT_TEST(cache.wants_rehash());
+        for(int k = 100; k < 110; ++k)
+            cache.put(k, k);
+        LIGHT_TEST(cache.container().tombstones() <= tombstones);
+        LIGHT_TEST(cache.get(39) == a && *a == 39 && cache.get(40) == b && *b == 40);
+        
+        cache.rehash();
+        LIGHT_TEST(!cache.wants_rehash() && cache.container().tombstones() == 0);
+        LIGHT_TEST(*cache.get(39) == 39 && cache.size() == 12);
+    }
+    
+    {
+        // In shared memory
+        using cache_t = hl::lru_cache<int, int, 4>;
+        LIGHT_TEST(std::is_standard_layout<cache_t>::value);
+        std::string name = "/ax.hashlist.lru." + std::to_string(getpid());
+        auto owner = hl::shared<cache_t>::create(name);
+        lru_cache_test(*owner);
+        auto view = hl::shared<cache_t>::attach(name);
+        LIGHT_TEST(view->stats().evictions == 5 && *view->get(12) == 12);
+        hl::shared<cache_t>::remove(name);
+    }
+}
+
+void big_test() {
+    // Offsets type is picked by capacity
+    static_assert(std::is_same<hl::hashlist<int, int, 1 << 14>::offset_type, int16_t>::value, "");
+    static_assert(std::is_same<hl::hashlist<int, int, 1 << 16>::offset_type, int32_t>::value, "");
+    static_assert(std::is_same<hl::hashlist<int, int, 1UL << 32>::offset_type, int64_t>::value, "");
+    
+    const size_t N = 1 << 20;
+    using hl_t = hl::hashlist<int, int, N>;
+    std::unique_ptr<hl_t> pl(new hl_t);
+    auto& l = *pl;
+    
+    for(size_t i = 0; i < N; ++i)
+        l.emplace_back(int(i), int(i));
+    LIGHT_TEST(l.size() == N);
+    
+    int expected = 0;
+    for(auto const& p : l)
+        LIGHT_TEST(p.first == expected++);
+    for(auto it = l.rbegin(); it != l.rend(); ++it)
+        LIGHT_TEST(it->first == --expected);
+    
+    for(size_t i = 0; i < N; i += 3)
+        l.erase(l.find(int(i)));
+    LIGHT_TEST(l.size() == N - (N + 2)/3);
+    
+    // Far jumps: first and last elements are spread over whole storage
+    auto first = l.begin();
+    auto last = --l.end();
+    LIGHT_TEST(first->first == 1 && last->first == int(N - 1) - int((N - 1) % 3 == 0));
+    LIGHT_TEST(l.element_by_offset(l.offset_of_element(last)) == last);
+    LIGHT_TEST(std::distance(l.begin(), l.end()) == static_cast<std::ptrdiff_t>(l.size()));
+    
+    expected = 1;
+    for(auto const& p : l) {
+        LIGHT_TEST(p.first == expected && p.second == expected);
+        expected += (expected % 3 == 1) ? 1 : 2;
+    }
+}
+
+void shm_test() {
+    using hl_t = hl::hashlist<int, int, 4096>;
+    using shared_t = hl::shared<hl_t>;
+    
+    for(auto backing : {hl::shm_options::posix_shm, hl::shm_options::file}) {
+        hl::shm_options opts(backing);
+        std::string name = (backing == hl::shm_options::posix_shm ? "/" : "/tmp/")
+            + std::string("ax.hashlist.test.") + std::to_string(getpid());
+        
+        auto owner = shared_t::create(name, opts);
+        LIGHT_TEST(owner->empty());
+        for(int i = 0; i < 1024; ++i)
+            owner->emplace_back(i, i*i);
+        
+        {
+            // Another mapping of the same segment (different address)
+            auto view = shared_t::attach(name, opts);
+            LIGHT_TEST(view.get() != owner.get());
+            LIGHT_TEST(view->size() == 1024);
+            LIGHT_TEST(std::equal(owner->begin(), owner->end(), view->begin()));
+            view->erase(view->find(0));
+            view->emplace_back(-1, -1);
+        }
+        LIGHT_TEST(owner->front().first == 1 && owner->back().first == -1);
+        
+        // Another process
+        pid_t pid = fork();
+        if(pid == 0) {
+            auto child = shared_t::attach(name, opts);
+            bool ok = child->size() == 1024 && child->find(42)->second == 42*42;
+            child->emplace_back(4242, 0);
+            _exit(ok ? 0 : 1);
+        }
+        int status = -1;
+        waitpid(pid, &status, 0);
+        LIGHT_TEST(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        LIGHT_TEST(owner->size() == 1025 && owner->back().first == 4242);
+        
+        // Layout mismatch is detected
+        bool mismatch = false;
+        try {
+            hl::shared<hl::hashlist<int, long, 4096>>::attach(name, opts);
+        } catch(std::runtime_error&) {
+            mismatch = true;
+        }
+        LIGHT_TEST(mismatch);
+        
+        owner.destroy();
+        shared_t::remove(name, opts);
+        
+        bool missing = false;
+        try {
+            shared_t::attach(name, opts);
+        } catch(std::system_error&) {
+            missing = true;
+        }
+        LIGHT_TEST(missing);
+    }
+}
+
+template <class hl_t>
+void seqlock_probe_test() {
+    // One writer and several readers checking invariant value == 3*key
+    using sl_t = hl::seqlocked<hl_t>;
+    std::unique_ptr<sl_t> psl(new sl_t);
+    auto& sl = *psl;
+    
+    const int domain = 2048;
+    std::atomic<bool> done(false);
+    std::atomic<size_t> torn(0);
+    
+    auto reader = [&](unsigned seed) {
+        std::vector<std::pair<int, long>> snap;
+        std::unique_ptr<hl_t> copy(new hl_t);
+        while(!done.load(std::memory_order_relaxed)) {
+            int key = int(seed = seed*1103515245 + 12345) % domain;
+            key = key < 0 ? -key : key;
+            long value = 0;
+            if(sl.find(key, value) && value != 3L*key)
+                ++torn;
+            
+            sl.snapshot(snap);
+            if(snap.size() > hl_t::max_size())
+                ++torn;
+            for(auto const& p : snap)
+                if(p.second != 3L*p.first)
+                    ++torn;
+            
+            auto version = sl.copy(*copy, [&sl] { return sl.version(); });
+            if(version % 2 != 0 || copy->size() > hl_t::max_size())
+                ++torn;
+            for(auto const& p : *copy)
+                if(p.second != 3L*p.first)
+                    ++torn;
+        }
+    };
+    
+    std::vector<std::thread> readers;
+    for(unsigned r = 0; r < 4; ++r)
+        readers.emplace_back(reader, r + 1);
+    
+    std::list<int> keys;
+    for(size_t i = 0; i < 256_KIB; ++i) {
+        int key = std::rand() % domain;
+        auto found = sl.unsafe().find(key);
+        if(found != sl.unsafe().end()) {
+            sl.erase(found);
+            keys.remove(key);
+        } else if(sl.unsafe().size() < hl_t::max_size() - 64) {
+            sl.emplace_back(key, 3L*key);
+            keys.push_back(key);
+        }
+        if(i % 4096 == 0)
+            sl.rehash();
+    }
+    
+    done = true;
+    for(auto& t : readers)
+        t.join();
+    
+    LIGHT_TEST(torn == 0);
+    LIGHT_TEST(sl.size() == keys.size());
+    LIGHT_TEST(sl.version() % 2 == 0);
+    
+    std::vector<std::pair<int, long>> snap;
+    sl.snapshot(snap);
+    LIGHT_TEST(std::equal(keys.begin(), keys.end(), snap.begin(),
+        [](int k, std::pair<int, long> const& p) { return k == p.first; }));
+}
+
+void seqlock_test() {
+    seqlock_probe_test<hl::hashlist<int, long, 1024>>();
+    seqlock_probe_test<hl::hashlist<int, long, 1024, hl::default_hash<int>, hl::group_probing, hl::no_stats, hl::split<0>>>();
+    seqlock_probe_test<hl::hashlist<int, long, 1024, hl::default_hash<int>, hl::robin_hood>>();
+}
+
+/// Hand-made change feed over a quiescent table: records are appended directly
+template <class hl_t>
+struct scripted_feed {
+    using container_type = hl_t;
+    using record_type = hl::change_record<hl_t>;
+    enum class fetch_result { ready, pending, lost };
+    
+    hl_t list;
+    std::vector<record_type> records;
+    
+    void push(hl::change_op op, size_t offset, typename hl_t::key_type key) {
+        record_type r;
+        std::memset(&r, 0, sizeof(r));
+        r.op = op;
+        r.offset = offset;
+        std::memcpy(&r.key_, &key, sizeof(key));
+        records.push_back(r);
+    }
+    
+    uint64_t head() const { return records.size(); }
+    
+    fetch_result fetch(uint64_t seq, record_type& out) const {
+        if(seq >= records.size())
+            return fetch_result::pending;
+        out = records[seq];
+        return fetch_result::ready;
+    }
+    
+    uint64_t copy(hl_t& out) const {
+        out = list;
+        return head();
+    }
+};
+
+template <class hl_t>
+void replica_churn_test() {
+    // Writer churns, replica polls concurrently and converges to the same cells
+    using feed_t = hl::logged<hl_t, 256>;
+    std::unique_ptr<feed_t> pfeed(new feed_t);
+    auto& feed = *pfeed;
+    
+    const int domain = 2048;
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+        for(size_t i = 0; i < 64_KIB; ++i) {
+            int key = std::rand() % domain;
+            auto found = feed.unsafe().find(key);
+            if(found != feed.unsafe().end()) {
+                if(i % 5 == 0)
+                    feed.move_to_back(found);
+                else if(i % 7 == 0)
+                    feed.insert_or_assign(key, 3L*key);
+                else
+                    feed.erase(found);
+            } else if(feed.unsafe().size() < hl_t::max_size() - 64) {
+                feed.emplace_back(key, 3L*key);
+            }
+            if(i % 4096 == 0)
+                feed.rehash();
+        }
+        feed.compact();
+        done = true;
+    });
+    
+    hl::replica<feed_t> rep(feed);
+    size_t polls = 0, broken = 0;
+    while(!done.load(std::memory_order_acquire)) {
+        rep.poll(64);
+        if(++polls % 64 == 0)
+            for(auto const& p : *rep)
+                if(p.second != 3L*p.first)
+                    ++broken;
+    }
+    writer.join();
+    rep.poll();
+    
+    LIGHT_TEST(broken == 0);
+    LIGHT_TEST(rep.lag() == 0 && rep.position() == feed.head());
+    LIGHT_TEST(same_cells(rep.get(), feed.unsafe()));
+}
+
+void replica_test() {
+    using hl_t = hl::hashlist<int, long, 1024>;
+    using feed_t = hl::logged<hl_t, 64>;
+    
+    {
+        // Every kind of record is replayed into the same cells
+        std::unique_ptr<feed_t> pfeed(new feed_t);
+        auto& feed = *pfeed;
+        hl::replica<feed_t> rep(feed);
+        LIGHT_TEST(rep.get().empty() && rep.position() == 0);
+        
+        for(int k = 0; k < 40; ++k)
+            feed.emplace_back(k, 3L*k);
+        LIGHT_TEST(rep.lag() == 40 && rep.poll(10) == 10 && rep.lag() == 30);
+        LIGHT_TEST(rep.poll() == 30 && same_cells(rep.get(), feed.unsafe()));
+        
+        feed.insert_or_assign(5, 0);
+        feed.insert_or_assign(100, 300);
+        feed.erase(7);
+        LIGHT_TEST(feed.erase(-1) == 0);
+        feed.erase(feed.unsafe().find(9));
+        feed.move_to_back(feed.unsafe().find(0));
+        feed.move_to_front(feed.unsafe().find(39));
+        feed.rehash();
+        feed.compact();
+        LIGHT_TEST(feed.head() == 48);
+        LIGHT_TEST(rep.poll() == 8 && same_cells(rep.get(), feed.unsafe()));
+        LIGHT_TEST(rep->find(5)->second == 0 && rep->back().first == 0 && rep->front().first == 39);
+        LIGHT_TEST(rep.resyncs() == 0);
+        
+        // Lapped replica takes block copy
+        for(int k = 1000; k < 1200; ++k)
+            feed.emplace_back(k, 3L*k);
+        feed.clear();
+        for(int k = 0; k < 10; ++k)
+            feed.emplace_back(k, 3L*k);
+        rep.poll();
+        LIGHT_TEST(rep.resyncs() == 1 && rep.lag() == 0);
+        LIGHT_TEST(same_cells(rep.get(), feed.unsafe()) && rep->size() == 10);
+        
+        // Replica constructed later starts from the current table
+        hl::replica<feed_t> late(feed);
+        LIGHT_TEST(late.position() == feed.head() && same_cells(late.get(), feed.unsafe()));
+        
+        long value = 0;
+        LIGHT_TEST(feed.find(3, value) && value == 9 && feed.size() == 10);
+        
+        // Failed emplace publishes nothing
+        bool thrown = false;
+        while(!thrown)
+            try { feed.emplace_back(0, 0L); } catch(std::bad_alloc&) { thrown = true; }
+        uint64_t head = feed.head();
+        LIGHT_TEST(feed.unsafe().size() == hl_t::max_size());
+        rep.poll();
+        LIGHT_TEST(same_cells(rep.get(), feed.unsafe()) && rep.position() == head);
+    }
+    
+    {
+        // Records naming erased cells don't match though the cells keep stale keys
+        using feed_t = scripted_feed<hl_t>;
+        std::unique_ptr<feed_t> pfeed(new feed_t);
+        auto& feed = *pfeed;
+        for(int k = 0; k < 10; ++k)
+            feed.list.emplace_back(k, 3L*k);
+        size_t five = feed.list.offset_of_element(feed.list.find(5));
+        size_t six = feed.list.offset_of_element(feed.list.find(6));
+        feed.list.erase(5);
+        feed.list.erase(6);
+        LIGHT_TEST(!feed.list.occupied(five) && feed.list.occupied(feed.list.offset_of_element(feed.list.find(7))));
+        LIGHT_TEST(!feed.list.occupied(0) && !feed.list.occupied(hl_t::max_size() + 1));
+        
+        hl::replica<feed_t> rep(feed);
+        feed.push(hl::change_op::erase, five, 5);
+        LIGHT_TEST(rep.poll(1) == 0 && rep.resyncs() == 1);
+        feed.push(hl::change_op::to_back, six, 6);
+        LIGHT_TEST(rep.poll(1) == 0 && rep.resyncs() == 2);
+        LIGHT_TEST(same_cells(rep.get(), feed.list) && rep->size() == 8);
+    }
+    
+    replica_churn_test<hl::hashlist<int, long, 1024>>();
+    replica_churn_test<hl::hashlist<int, long, 1024, hl::default_hash<int>, hl::robin_hood>>();
+    
+    {
+        // Replica in another process
+        using shared_t = hl::shared<hl::logged<hl_t, 1024>>;
+        std::string name = "/ax.hashlist.replica." + std::to_string(getpid());
+        auto owner = shared_t::create(name);
+        
+        pid_t pid = fork();
+        if(pid == 0) {
+            auto view = shared_t::attach(name);
+            hl::replica<hl::logged<hl_t, 1024>> rep(*view);
+            while(rep.get().find(-1) == rep.get().end())
+                rep.poll();
+            bool ok = rep.lag() == 0 && same_cells(rep.get(), view->unsafe());
+            for(auto const& p : *rep)
+                ok = ok && (p.first == -1 || p.second == 3L*p.first);
+            _exit(ok ? 0 : 1);
+        }
+        
+        for(int i = 0; i < 20000; ++i) {
+            int key = i % 1500;
+            if(owner->unsafe().find(key) != owner->unsafe().end())
+                owner->erase(key);
+            else if(owner->unsafe().size() < hl_t::max_size() - 64)
+                owner->emplace_back(key, 3L*key);
+        }
+        owner->emplace_back(-1, 0L);
+        
+        int status = -1;
+        waitpid(pid, &status, 0);
+        LIGHT_TEST(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        
+        owner.destroy();
+        shared_t::remove(name);
+    }
+}
+
+void sharded_test() {
+    // Several writers, disjoint keys, global order is kept per writer
+    const size_t writers = 8;
+    const int per_writer = 2000;
+    using sh_t = hl::sharded_hashlist<int, int, 4096, 8, hl::FNV_1<int>, true>;
+    std::unique_ptr<sh_t> psh(new sh_t);
+    auto& sh = *psh;
+    
+    std::vector<std::thread> threads;
+    for(size_t w = 0; w < writers; ++w) {
+        threads.emplace_back([&sh, w]() {
+            for(int i = 0; i < per_writer; ++i) {
+                int key = int(w)*per_writer + i;
+                sh.emplace_back(key, -key);
+                if(i % 3 == 0)
+                    sh.erase(key);
+            }
+        });
+    }
+    for(auto& t : threads)
+        t.join();
+    
+    size_t expected = writers*(per_writer - (per_writer + 2)/3);
+    LIGHT_TEST(sh.size() == expected);
+    
+    size_t count = 0;
+    for(size_t s = 0; s < sh.shards(); ++s) {
+        size_t in_shard = 0;
+        sh.for_each_in_shard(s, [&](int key, int& value) {
+            LIGHT_TEST(sh_t::shard_of(key) == s && value == -key);
+            ++in_shard;
+        });
+        LIGHT_TEST(in_shard > 0);
+        count += in_shard;
+    }
+    LIGHT_TEST(count == expected);
+    
+    std::vector<int> last(writers, -1);
+    count = 0;
+    sh.for_each_ordered([&](int key, int&) {
+        size_t w = key / per_writer;
+        LIGHT_TEST(key > last[w]);
+        last[w] = key;
+        ++count;
+    });
+    LIGHT_TEST(count == expected);
     
-    out << "\n\n";
+    int value = 0;
+    LIGHT_TEST(sh.find(1, value) && value == -1);
+    LIGHT_TEST(!sh.find(0, value));
+    LIGHT_TEST(sh.visit(1, [](int, int& v) { v = 42; }));
+    LIGHT_TEST(sh.find(1, value) && value == 42);
     
-    out.close();
+    sh.clear();
+    LIGHT_TEST(sh.size() == 0);
 }
 
 int main() {
     haslist_test();
-    perf();
+    probe_policies_test();
+    hash_policies_test();
+    direct_test();
+    upsert_policies_test();
+    multimap_policies_test();
+    stats_policies_test();
+    bulk_erase_test();
+    compact_policies_test();
+    unordered_policies_test();
+    copy_test();
+    snapshot_test();
+    layout_test();
+    range_policies_test();
+    dynamic_test();
+    lru_test();
+    big_test();
+    shm_test();
+    seqlock_test();
+    replica_test();
+    sharded_test();
 }
\ No newline at end of file